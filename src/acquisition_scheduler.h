@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "timing_wheel.h"
+
+// 按设备采集周期独立调度的采集计划
+// 每个设备有自己的截止时间，到期后下一次截止时间 = 本次截止时间 + 周期（而不是当前时间 + 周期），
+// 这样处理耗时和tick误差不会累积成漂移；落后超过一个完整周期的直接跳过并计数。
+// 按墙上时间对齐的首次采集相位：每个设备在自己周期的整数倍时刻采集（如周期2s时在每个偶数秒），
+// 再把 stagger[i]（周期内的相位）按比例压缩到 windowMs 之内错开，同一时刻的采样集中在一个小窗口里又不会同时占用总线。
+// 返回值用作 AcquisitionScheduler 的 offsets，需在构造调度器之前立即计算
+inline std::vector<int> alignedOffsets(const std::vector<int>& cycles, const std::vector<int>& stagger, int windowMs) {
+    int64_t wallMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<int> offsets(cycles.size(), 0);
+    for (size_t i = 0; i < cycles.size(); ++i) {
+        int64_t cycle = cycles[i] > 0 ? cycles[i] : 1000;
+        int64_t toBoundary = (cycle - wallMs % cycle) % cycle;
+        int64_t window = std::min<int64_t>(std::max(windowMs, 0), cycle);
+        int64_t shift = i < stagger.size() ? (std::max(stagger[i], 0) % cycle) * window / cycle : 0;
+        offsets[i] = static_cast<int>(toBoundary + shift);
+    }
+    return offsets;
+}
+
+// 没有总线规划的通道（push、dimming、模拟）用的 stagger：同一周期的设备在周期内均匀分布，
+// 经 alignedOffsets 压缩后在错开窗口内等间距排开
+inline std::vector<int> evenStagger(const std::vector<int>& cycles) {
+    std::map<int64_t, int64_t> total;
+    std::map<int64_t, int64_t> seen;
+    for (int cycle : cycles) {
+        ++total[cycle > 0 ? cycle : 1000];
+    }
+    std::vector<int> stagger(cycles.size(), 0);
+    for (size_t i = 0; i < cycles.size(); ++i) {
+        int64_t cycle = cycles[i] > 0 ? cycles[i] : 1000;
+        stagger[i] = static_cast<int>(seen[cycle]++ * cycle / total[cycle]);
+    }
+    return stagger;
+}
+
+class AcquisitionScheduler {
+public:
+    using ptr = std::shared_ptr<AcquisitionScheduler>;
+    using Clock = std::chrono::steady_clock;
+
+    struct SlotStats {
+        uint64_t fired;
+        uint64_t late;
+        uint64_t skipped;
+        int64_t lastLatenessMs;
+        int64_t maxLatenessMs;
+        uint64_t realigned;
+    };
+
+    // cycles[i] 为第i个设备的采集周期(ms)，tickMs 为时间轮精度
+    // offsets[i] 为第i个设备首次采集的相位(ms)，为空时全部从0开始
+    AcquisitionScheduler(const std::vector<int>& cycles, int tick = 10, const std::vector<int>& offsets = std::vector<int>())
+        : tickMs(tick > 0 ? tick : 1), wheel(cycles.size()), slots(cycles.size()), origin(Clock::now()) {
+        for (size_t i = 0; i < cycles.size(); ++i) {
+            slots[i].cycleMs = cycles[i] > 0 ? cycles[i] : static_cast<int>(kDefaultCycleMs);
+            slots[i].deadlineMs = i < offsets.size() ? std::max(offsets[i], 0) % slots[i].cycleMs : 0;
+            wheel.schedule(static_cast<uint32_t>(i), static_cast<uint64_t>((slots[i].deadlineMs + tickMs - 1) / tickMs));
+        }
+    }
+
+    size_t size() const { return slots.size(); }
+
+    int cycleOf(size_t index) const { return slots[index].cycleMs; }
+
+    // 阻塞到下一个tick，把到期设备的下标写入due（可能为空）
+    void waitTick(std::vector<uint32_t>& due) {
+        due.clear();
+        std::this_thread::sleep_until(origin + std::chrono::milliseconds(wheel.now() * tickMs));
+        collectDue(Clock::now(), due);
+    }
+
+    // 收集截至now的到期设备，并按漂移补偿规则重新排期
+    void collectDue(Clock::time_point now, std::vector<uint32_t>& due) {
+        int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - origin).count();
+        if (nowMs < 0) {
+            return;
+        }
+        size_t first = due.size();
+        wheel.advanceTo(static_cast<uint64_t>(nowMs / tickMs), due);
+
+        for (size_t i = first; i < due.size(); ++i) {
+            Slot& slot = slots[due[i]];
+            int64_t lateness = nowMs - slot.deadlineMs;
+            slot.fired.fetch_add(1, std::memory_order_relaxed);
+            slot.lastLatenessMs.store(lateness, std::memory_order_relaxed);
+            if (lateness > slot.maxLatenessMs.load(std::memory_order_relaxed)) {
+                slot.maxLatenessMs.store(lateness, std::memory_order_relaxed);
+            }
+            if (lateness > tickMs) {
+                slot.late.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            int64_t next = slot.deadlineMs + slot.cycleMs;
+            if (next <= nowMs) {
+                int64_t missed = (nowMs - slot.deadlineMs) / slot.cycleMs;
+                slot.skipped.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+                next = slot.deadlineMs + (missed + 1) * slot.cycleMs;
+            }
+            slot.deadlineMs = next;
+            wheel.schedule(due[i], static_cast<uint64_t>((next + tickMs - 1) / tickMs));
+        }
+    }
+
+    // 调度按单调时钟推进，墙上时间被校准（NTP）后对齐的采集时刻会逐渐偏离整数倍时刻。
+    // offsets 为按当前墙上时间重新计算的相位（alignedOffsets 的结果），与现有截止时间相差超过一个tick的设备改用新相位，
+    // 返回校正的设备数；只在调用 waitTick 的线程中调用
+    size_t realign(const std::vector<int>& offsets, Clock::time_point now) {
+        int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - origin).count();
+        size_t moved = 0;
+        for (size_t i = 0; i < slots.size() && i < offsets.size(); ++i) {
+            Slot& slot = slots[i];
+            int64_t cycle = slot.cycleMs;
+            int64_t target = nowMs + std::max(offsets[i], 0) % cycle;
+            int64_t drift = ((slot.deadlineMs - target) % cycle + cycle) % cycle;
+            if (drift > cycle / 2) {
+                drift -= cycle;
+            }
+            if (std::llabs(drift) <= tickMs) {
+                continue;
+            }
+            slot.deadlineMs = target;
+            wheel.schedule(static_cast<uint32_t>(i), static_cast<uint64_t>((target + tickMs - 1) / tickMs));
+            slot.realigned.fetch_add(1, std::memory_order_relaxed);
+            ++moved;
+        }
+        return moved;
+    }
+
+    SlotStats statsOf(size_t index) const {
+        const Slot& slot = slots[index];
+        SlotStats stats;
+        stats.fired = slot.fired.load(std::memory_order_relaxed);
+        stats.late = slot.late.load(std::memory_order_relaxed);
+        stats.skipped = slot.skipped.load(std::memory_order_relaxed);
+        stats.lastLatenessMs = slot.lastLatenessMs.load(std::memory_order_relaxed);
+        stats.maxLatenessMs = slot.maxLatenessMs.load(std::memory_order_relaxed);
+        stats.realigned = slot.realigned.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    enum { kDefaultCycleMs = 1000 };
+
+    struct Slot {
+        int cycleMs = kDefaultCycleMs;
+        int64_t deadlineMs = 0;
+        std::atomic<uint64_t> fired{0};
+        std::atomic<uint64_t> late{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<int64_t> lastLatenessMs{0};
+        std::atomic<int64_t> maxLatenessMs{0};
+        std::atomic<uint64_t> realigned{0};
+    };
+
+    int tickMs;
+    TimingWheel wheel;
+    std::vector<Slot> slots;
+    Clock::time_point origin;
+};
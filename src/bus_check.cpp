@@ -0,0 +1,249 @@
+// 串口采集检查
+// 在 --dir 下生成一个 modbus-rtu 通道的配置，启动 BusSimulator（--keep-addresses --fixed-values）在伪终端上模拟从站，
+// 再用网关的 SerialReactor + ModbusRtuMaster 按采集计划读取：
+//   1. 同一从站上相邻的设备合并为一次请求，请求数等于规划的条数；
+//   2. 按设备拆分后的寄存器值等于模拟器的固定值（从站*1000+寄存器地址）；
+//   3. 没有应答的从站在应答超时后返回 Timeout，超时计数加一，之后的请求照常成功。
+// 任一项不符即返回1。由 ctest 运行，也可以单独运行：./BusCheck --simulator ./BusSimulator --dir /tmp/bus-check
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <json/json.h>
+#include "modbus_rtu.h"
+#include "serial_reactor.h"
+
+struct CheckOptions {
+    std::string simulator = "./BusSimulator";
+    std::string dir = "bus-check";
+    int responseTimeoutMs = 100;
+};
+
+struct CheckDevice {
+    int address;
+    int startOffset;
+    int registers;
+};
+
+// 从站1上三台相邻的设备合并为一次请求，从站2单独一次；从站9没有设备，用来检查超时
+const CheckDevice kDevices[] = {
+    {1, 0, 2},
+    {1, 2, 2},
+    {1, 4, 1},
+    {2, 10, 3},
+};
+const size_t kExpectedRequests = 2;
+const uint8_t kSilentSlave = 9;
+
+int failures = 0;
+
+void expect(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+void writeJson(const std::string& path, const Json::Value& value) {
+    std::ofstream file(path);
+    Json::StreamWriterBuilder writer;
+    file << Json::writeString(writer, value);
+}
+
+// 通道配置和集群配置，串口路径由模拟器改写
+void writeConfig(const CheckOptions& options) {
+    Json::Value channel;
+    channel["uuid"] = "B05C0000000000000000000000000001";
+    channel["key"] = "bus-check";
+    channel["alias"] = "bus-check";
+    channel["device-type"] = "cluster";
+    channel["model-type"] = "modbus-rtu";
+    channel["dev"]["instance"] = "/dev/null";
+    channel["dev"]["baud-rate"] = 115200;
+    Json::Value root;
+    root["devices"].append(channel);
+    writeJson(options.dir + "/serial_config.json", root);
+
+    Json::Value cluster;
+    cluster["cluster-name"] = "bus-check";
+    for (const auto& device : kDevices) {
+        Json::Value item;
+        item["address"] = device.address;
+        item["start-offset"] = device.startOffset;
+        for (int i = 0; i < device.registers; ++i) {
+            item["fields"].append("r" + std::to_string(i));
+        }
+        cluster["devices"].append(item);
+    }
+    writeJson(options.dir + "/" + channel["uuid"].asString() + ".json", cluster);
+}
+
+pid_t startSimulator(const CheckOptions& options) {
+    std::string config = options.dir + "/serial_config.json";
+    std::string out = options.dir + "/sim";
+    std::remove((out + "/serial_config.json").c_str());
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(options.simulator.c_str(), options.simulator.c_str(), "--config", config.c_str(), "--out", out.c_str(),
+              "--keep-addresses", "--fixed-values", "--latency", "1", static_cast<char*>(nullptr));
+        std::cerr << "Failed to start " << options.simulator << std::endl;
+        _exit(127);
+    }
+    return pid;
+}
+
+// 等模拟器写出生成的配置，返回伪终端路径
+std::string waitForPort(const CheckOptions& options, pid_t simulator) {
+    for (int i = 0; i < 100; ++i) {
+        std::ifstream file(options.dir + "/sim/serial_config.json");
+        Json::Value root;
+        Json::CharReaderBuilder reader;
+        std::string errors;
+        if (file.is_open() && Json::parseFromStream(reader, file, &root, &errors) && root["devices"].size() == 1) {
+            return root["devices"][0]["dev"]["instance"].asString();
+        }
+        if (waitpid(simulator, nullptr, WNOHANG) == simulator) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return std::string();
+}
+
+void checkCoalescedReads(ModbusRtuMaster& master) {
+    std::vector<ModbusReadSpec> specs;
+    for (size_t i = 0; i < sizeof(kDevices) / sizeof(kDevices[0]); ++i) {
+        ModbusReadSpec spec;
+        spec.slave = static_cast<uint8_t>(kDevices[i].address);
+        spec.start = static_cast<uint16_t>(kDevices[i].startOffset);
+        spec.count = static_cast<uint16_t>(kDevices[i].registers);
+        spec.owner = static_cast<uint32_t>(i);
+        specs.push_back(spec);
+    }
+    std::vector<ModbusReadRequest> requests = planModbusReads(specs);
+    expect(requests.size() == kExpectedRequests, "planned " + std::to_string(requests.size()) + " requests, expected " +
+           std::to_string(kExpectedRequests));
+
+    uint64_t before = master.getStats().transactions.load();
+    std::vector<uint16_t> registers;
+    size_t decoded = 0;
+    for (const auto& request : requests) {
+        ModbusStatus status = master.read(request, registers);
+        expect(status == ModbusStatus::Ok, "read from slave " + std::to_string(request.slave) + " failed");
+        if (status != ModbusStatus::Ok) {
+            continue;
+        }
+        // 和网关一样按成员拆分，按有符号16位解析
+        for (const auto& member : request.members) {
+            const CheckDevice& device = kDevices[member.owner];
+            expect(member.count == device.registers, "member register count");
+            for (uint16_t i = 0; i < member.count; ++i) {
+                int value = static_cast<int16_t>(registers[member.offset + i]);
+                int expected = device.address * 1000 + device.startOffset + i;
+                expect(value == expected, "device " + std::to_string(member.owner) + " register " + std::to_string(i) +
+                       ": got " + std::to_string(value) + ", expected " + std::to_string(expected));
+            }
+            ++decoded;
+        }
+    }
+    uint64_t transactions = master.getStats().transactions.load() - before;
+    expect(transactions == kExpectedRequests, "bus transactions " + std::to_string(transactions) + ", expected " +
+           std::to_string(kExpectedRequests));
+    expect(decoded == sizeof(kDevices) / sizeof(kDevices[0]), "decoded " + std::to_string(decoded) + " devices");
+    std::cout << "coalesced reads: " << transactions << " transactions for " << decoded << " devices" << std::endl;
+}
+
+void checkTimeout(ModbusRtuMaster& master, SerialReactor& reactor, int portId, const CheckOptions& options) {
+    ModbusReadSpec spec;
+    spec.slave = kSilentSlave;
+    spec.count = 1;
+    uint64_t timeouts = reactor.statsOf(portId).timeouts.load();
+    std::vector<uint16_t> registers;
+    auto begin = std::chrono::steady_clock::now();
+    ModbusStatus status = master.read(planModbusReads(std::vector<ModbusReadSpec>(1, spec)).front(), registers);
+    int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    expect(status == ModbusStatus::Timeout, "read from silent slave did not time out");
+    expect(elapsedMs >= options.responseTimeoutMs && elapsedMs < options.responseTimeoutMs + 200,
+           "timeout took " + std::to_string(elapsedMs) + " ms, response timeout " + std::to_string(options.responseTimeoutMs) + " ms");
+    expect(reactor.statsOf(portId).timeouts.load() == timeouts + 1, "reactor timeout count");
+    std::cout << "timeout: " << elapsedMs << " ms" << std::endl;
+
+    // 超时之后总线照常可用
+    spec.slave = static_cast<uint8_t>(kDevices[0].address);
+    spec.start = static_cast<uint16_t>(kDevices[0].startOffset);
+    ModbusStatus after = master.read(planModbusReads(std::vector<ModbusReadSpec>(1, spec)).front(), registers);
+    expect(after == ModbusStatus::Ok, "read after timeout failed");
+}
+
+bool parseOptions(int argc, char* argv[], CheckOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--simulator" && hasValue) {
+            options.simulator = argv[++i];
+        } else if (arg == "--dir" && hasValue) {
+            options.dir = argv[++i];
+        } else if (arg == "--response-timeout" && hasValue) {
+            options.responseTimeoutMs = std::max(10, std::atoi(argv[++i]));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    CheckOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: BusCheck [--simulator PATH] [--dir DIR] [--response-timeout MS]" << std::endl;
+        return 1;
+    }
+    mkdir(options.dir.c_str(), 0755);
+    writeConfig(options);
+
+    pid_t simulator = startSimulator(options);
+    if (simulator < 0) {
+        return 1;
+    }
+    std::string path = waitForPort(options, simulator);
+    if (path.empty()) {
+        std::cout << "FAILED: simulator did not start" << std::endl;
+        kill(simulator, SIGKILL);
+        waitpid(simulator, nullptr, 0);
+        return 1;
+    }
+
+    SerialPortConfig config;
+    config.instance = path;
+    config.baudRate = 115200;
+    config.responseTimeoutMs = options.responseTimeoutMs;
+    {
+        SerialReactor reactor;
+        int portId = reactor.addPort(config);
+        expect(portId >= 0, "failed to open " + path);
+        if (portId >= 0) {
+            reactor.start();
+            ReactorTransport transport(reactor, portId);
+            ModbusRtuMaster master(transport, config);
+            checkCoalescedReads(master);
+            checkTimeout(master, reactor, portId, options);
+            reactor.stop();
+        }
+    }
+
+    kill(simulator, SIGTERM);
+    waitpid(simulator, nullptr, 0);
+    if (failures > 0) {
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,518 @@
+// 串口总线模拟器
+// 读取 serial_config.json 及其引用的集群配置文件，为每个通道创建伪终端并模拟其上的从站：
+// modbus-rtu 通道应答读寄存器请求（push 通道按采集周期主动上报），dimming-rtu 通道应答调光命令。
+// 设备可以按倍数复制以模拟成千上万台设备，生成的配置写到输出目录，在该目录下运行 MQTTServer 即可连到模拟总线。
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <json/json.h>
+#include "modbus_rtu.h"
+#include "dimming_rtu.h"
+
+struct SimulatorOptions {
+    std::string config = "serial_config.json";
+    std::string outDir = "sim";
+    int scale = 1;
+    int devicesPerPort = 200;
+    int latencyMs = 5;
+    double errorRate = 0.0;
+    bool pace = true;
+    // 沿用配置中的 modbus 从站地址（同一从站上可以有多台设备），寄存器值固定为 从站*1000+寄存器地址，供 BusCheck 校验
+    bool keepAddresses = false;
+    bool fixedValues = false;
+};
+
+struct SimulatedDevice {
+    Json::Value config;
+    int address = 0;
+    int startOffset = 0;
+    int registers = 0;
+    int cycleMs = 1000;
+    uint8_t sid[4] = {0, 0, 0, 0};
+    uint8_t channel = 0;
+    uint8_t level = 0;
+    std::vector<int16_t> values;
+    std::chrono::steady_clock::time_point nextPush;
+};
+
+std::atomic<bool> running(true);
+
+std::string makeUUID(std::mt19937& gen) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string uuid;
+    for (int i = 0; i < 32; ++i) {
+        uuid.push_back(digits[gen() % 16]);
+    }
+    return uuid;
+}
+
+// 一个伪终端上的所有从站
+class SimulatedBus {
+public:
+    struct Stats {
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> responses{0};
+        std::atomic<uint64_t> pushes{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> corrupted{0};
+    };
+
+    SimulatedBus(const Json::Value& channelConfig, const SimulatorOptions& options, unsigned seed)
+        : channelConfig(channelConfig), options(options), gen(seed), masterFd(-1), slaveFd(-1) {
+        modelType = channelConfig["model-type"].asString();
+        push = channelConfig["fetch-type"].asString() == "push";
+        port.baudRate = channelConfig["dev"].get("baud-rate", 9600).asInt();
+        port.dataBits = channelConfig["dev"].get("data-bits", 8).asInt();
+        port.parity = channelConfig["dev"].get("parity", "n").asString();
+        port.stopBits = channelConfig["dev"].get("stop-bits", "1").asString();
+    }
+
+    ~SimulatedBus() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (slaveFd >= 0) {
+            ::close(slaveFd);
+        }
+        if (masterFd >= 0) {
+            ::close(masterFd);
+        }
+    }
+
+    // 创建伪终端，返回从端路径
+    bool open() {
+        masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+            std::cerr << "Failed to create pseudo terminal" << std::endl;
+            return false;
+        }
+        slavePath = ptsname(masterFd);
+
+        // 保持从端打开并设为原始模式，避免网关打开之前回显或挂断
+        slaveFd = ::open(slavePath.c_str(), O_RDWR | O_NOCTTY);
+        struct termios tio;
+        if (slaveFd < 0 || tcgetattr(slaveFd, &tio) != 0) {
+            std::cerr << "Failed to open " << slavePath << std::endl;
+            return false;
+        }
+        cfmakeraw(&tio);
+        tcsetattr(slaveFd, TCSANOW, &tio);
+        tcgetattr(masterFd, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(masterFd, TCSANOW, &tio);
+        port.instance = slavePath;
+        return true;
+    }
+
+    bool full() const {
+        if (modelType == "modbus-rtu") {
+            return static_cast<int>(devices.size()) >= std::min(options.devicesPerPort, 247);
+        }
+        return static_cast<int>(devices.size()) >= options.devicesPerPort;
+    }
+
+    // 复制一台设备到本总线，modbus 从站地址和调光灯地址在总线内保持唯一
+    void addDevice(const Json::Value& original, std::mt19937& uuidGen) {
+        SimulatedDevice device;
+        device.config = original;
+        device.config["uuid"] = makeUUID(uuidGen);
+        device.startOffset = original["start-offset"].asInt();
+        device.registers = static_cast<int>(original["fields"].size());
+        device.cycleMs = std::max(1, original.get("acquisition-cycle", 1000).asInt());
+        device.values.assign(std::max(device.registers, 1), static_cast<int16_t>(200 + gen() % 100));
+
+        if (modelType == "modbus-rtu") {
+            device.address = options.keepAddresses ? original["address"].asInt() : static_cast<int>(devices.size()) + 1;
+            device.config["address"] = device.address;
+            if (device.address > 0 && device.address < 256) {
+                devicesBySlave[device.address].push_back(devices.size());
+            }
+        } else {
+            uint32_t index = static_cast<uint32_t>(devices.size());
+            device.sid[0] = 0x84;
+            device.sid[1] = 0x14;
+            device.sid[2] = static_cast<uint8_t>(index >> 8);
+            device.sid[3] = static_cast<uint8_t>(index & 0xFF);
+            char sid[32];
+            snprintf(sid, sizeof(sid), "%02X.%02X.%02X.%02X H", device.sid[0], device.sid[1], device.sid[2], device.sid[3]);
+            device.config["device-sid"] = sid;
+            device.channel = static_cast<uint8_t>(original["channel"].asInt());
+        }
+        device.nextPush = std::chrono::steady_clock::now() + std::chrono::milliseconds(gen() % device.cycleMs);
+        devices.push_back(device);
+    }
+
+    // 生成本总线对应的通道配置和集群配置文件
+    Json::Value writeConfig(const std::string& outDir, std::mt19937& uuidGen, int index) {
+        Json::Value channel = channelConfig;
+        channel["uuid"] = makeUUID(uuidGen);
+        channel["key"] = channelConfig["key"].asString() + "-sim-" + std::to_string(index);
+        channel["dev"]["instance"] = slavePath;
+        if (modelType == "dimming-rtu") {
+            // 模拟器应答的是占位帧格式
+            channel["dimming-frame"] = "placeholder";
+        }
+
+        Json::Value cluster;
+        cluster["cluster-name"] = channel["key"];
+        cluster["devices"] = Json::Value(Json::arrayValue);
+        for (const auto& device : devices) {
+            cluster["devices"].append(device.config);
+        }
+        std::ofstream file(outDir + "/" + channel["uuid"].asString() + ".json");
+        Json::StreamWriterBuilder writer;
+        file << Json::writeString(writer, cluster);
+        return channel;
+    }
+
+    void start() {
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    size_t size() const { return devices.size(); }
+    const std::string& path() const { return slavePath; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    Json::Value channelConfig;
+    SimulatorOptions options;
+    SerialPortConfig port;
+    std::string modelType;
+    bool push = false;
+    std::mt19937 gen;
+    int masterFd;
+    int slaveFd;
+    std::string slavePath;
+    std::vector<SimulatedDevice> devices;
+    // 从站地址到 devices 下标
+    std::vector<std::vector<size_t>> devicesBySlave = std::vector<std::vector<size_t>>(256);
+    std::vector<uint8_t> rx;
+    std::thread worker;
+    Stats stats;
+
+    void run() {
+        uint8_t buffer[1024];
+        while (running.load()) {
+            int timeoutMs = 100;
+            auto now = std::chrono::steady_clock::now();
+            if (push) {
+                for (auto& device : devices) {
+                    if (device.nextPush <= now) {
+                        pushFrame(device);
+                        device.nextPush += std::chrono::milliseconds(device.cycleMs);
+                    }
+                    int wait = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(device.nextPush - now).count());
+                    timeoutMs = std::max(0, std::min(timeoutMs, wait));
+                }
+            }
+
+            struct pollfd pfd = {masterFd, POLLIN, 0};
+            if (::poll(&pfd, 1, timeoutMs) <= 0) {
+                continue;
+            }
+            ssize_t n = ::read(masterFd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                // 网关还没打开串口或已关闭
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            rx.insert(rx.end(), buffer, buffer + n);
+            if (modelType == "modbus-rtu") {
+                parseModbus();
+            } else {
+                parseDimming();
+            }
+        }
+    }
+
+    void parseModbus() {
+        while (rx.size() >= 8) {
+            if (!modbusCrcValid(rx.data(), 8)) {
+                rx.erase(rx.begin());
+                continue;
+            }
+            uint8_t slave = rx[0];
+            uint8_t function = rx[1];
+            uint16_t start = static_cast<uint16_t>((rx[2] << 8) | rx[3]);
+            uint16_t count = static_cast<uint16_t>((rx[4] << 8) | rx[5]);
+            rx.erase(rx.begin(), rx.begin() + 8);
+            stats.requests.fetch_add(1, std::memory_order_relaxed);
+
+            if (devicesBySlave[slave].empty() ||
+                (function != MODBUS_READ_HOLDING_REGISTERS && function != MODBUS_READ_INPUT_REGISTERS)) {
+                continue;
+            }
+            std::vector<uint8_t> response;
+            response.push_back(slave);
+            if (count == 0 || count > 125) {
+                response.push_back(static_cast<uint8_t>(function | 0x80));
+                response.push_back(0x03);
+            } else {
+                response.push_back(function);
+                response.push_back(static_cast<uint8_t>(count * 2));
+                for (uint16_t i = 0; i < count; ++i) {
+                    uint16_t value = registerValue(slave, start + i);
+                    response.push_back(static_cast<uint8_t>(value >> 8));
+                    response.push_back(static_cast<uint8_t>(value & 0xFF));
+                }
+            }
+            appendModbusCrc(response);
+            reply(response, 8);
+        }
+    }
+
+    void parseDimming() {
+        while (rx.size() >= 12) {
+            if (rx[0] != 0xA5 || rx[1] != 8 || !modbusCrcValid(rx.data(), 12)) {
+                rx.erase(rx.begin());
+                continue;
+            }
+            std::vector<uint8_t> command(rx.begin(), rx.begin() + 12);
+            rx.erase(rx.begin(), rx.begin() + 12);
+            stats.requests.fetch_add(1, std::memory_order_relaxed);
+
+            SimulatedDevice* target = nullptr;
+            for (auto& device : devices) {
+                if (std::equal(device.sid, device.sid + 4, command.begin() + 2) && device.channel == command[6]) {
+                    target = &device;
+                    break;
+                }
+            }
+            if (target == nullptr) {
+                continue;
+            }
+            if (command[7] == DIMMING_SET_LEVEL) {
+                target->level = command[9];
+            }
+            std::vector<uint8_t> ack(command.begin(), command.begin() + 9);
+            ack[1] = 9;
+            ack[7] = static_cast<uint8_t>(command[7] | 0x80);
+            ack.push_back(0);
+            ack.push_back(target->level);
+            appendModbusCrc(ack);
+            reply(ack, 12);
+        }
+    }
+
+    // 从站上覆盖该寄存器的设备的值，没有设备覆盖的寄存器为0
+    uint16_t registerValue(uint8_t slave, int address) {
+        for (size_t index : devicesBySlave[slave]) {
+            SimulatedDevice& device = devices[index];
+            if (address >= device.startOffset && address < device.startOffset + static_cast<int>(device.values.size())) {
+                return registerValue(device, address);
+            }
+        }
+        return 0;
+    }
+
+    // 寄存器值在设备起始地址之后依次对应各字段，每次读取做一次小幅随机游走
+    uint16_t registerValue(SimulatedDevice& device, int address) {
+        int index = address - device.startOffset;
+        if (index < 0 || index >= static_cast<int>(device.values.size())) {
+            return 0;
+        }
+        if (options.fixedValues) {
+            return static_cast<uint16_t>(device.address * 1000 + address);
+        }
+        device.values[index] = static_cast<int16_t>(device.values[index] + static_cast<int>(gen() % 3) - 1);
+        return static_cast<uint16_t>(device.values[index]);
+    }
+
+    void pushFrame(SimulatedDevice& device) {
+        std::vector<uint8_t> frame;
+        frame.push_back(static_cast<uint8_t>(device.address));
+        frame.push_back(MODBUS_READ_HOLDING_REGISTERS);
+        frame.push_back(static_cast<uint8_t>(device.registers * 2));
+        for (int i = 0; i < device.registers; ++i) {
+            uint16_t value = registerValue(device, device.startOffset + i);
+            frame.push_back(static_cast<uint8_t>(value >> 8));
+            frame.push_back(static_cast<uint8_t>(value & 0xFF));
+        }
+        appendModbusCrc(frame);
+        stats.pushes.fetch_add(1, std::memory_order_relaxed);
+        send(frame);
+    }
+
+    // 应答前等待：请求在线上的传输时间 + 从站响应延迟
+    void reply(std::vector<uint8_t>& frame, size_t requestLength) {
+        std::uniform_real_distribution<> chance(0.0, 1.0);
+        if (options.errorRate > 0 && chance(gen) < options.errorRate) {
+            if (chance(gen) < 0.5) {
+                stats.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            frame.back() ^= 0xFF;
+            stats.corrupted.fetch_add(1, std::memory_order_relaxed);
+        }
+        int64_t delayUs = static_cast<int64_t>(options.latencyMs) * 1000;
+        if (options.pace) {
+            delayUs += port.charsToMicros(static_cast<double>(requestLength));
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+        stats.responses.fetch_add(1, std::memory_order_relaxed);
+        send(frame);
+    }
+
+    // 按波特率节流写出，模拟帧在线上的传输时间
+    void send(const std::vector<uint8_t>& frame) {
+        if (options.pace) {
+            std::this_thread::sleep_for(std::chrono::microseconds(port.charsToMicros(static_cast<double>(frame.size()))));
+        }
+        size_t written = 0;
+        while (written < frame.size()) {
+            ssize_t n = ::write(masterFd, frame.data() + written, frame.size() - written);
+            if (n <= 0) {
+                return;
+            }
+            written += static_cast<size_t>(n);
+        }
+    }
+};
+
+void printUsage() {
+    std::cout << "Usage: BusSimulator [options]\n"
+              << "  --config FILE          serial_config.json to simulate (default serial_config.json)\n"
+              << "  --out DIR              directory for generated configuration (default sim)\n"
+              << "  --scale N              copies of every configured device (default 1)\n"
+              << "  --devices-per-port N   devices per pseudo terminal, modbus at most 247 (default 200)\n"
+              << "  --latency MS           slave response latency (default 5)\n"
+              << "  --error-rate P         probability of a dropped or corrupted reply (default 0)\n"
+              << "  --no-pace              do not pace frames at the configured baud rate\n"
+              << "  --keep-addresses       keep the configured modbus addresses instead of renumbering slaves\n"
+              << "  --fixed-values         register value = slave * 1000 + register address, no random walk\n";
+}
+
+bool parseOptions(int argc, char* argv[], SimulatorOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--config" && hasValue) {
+            options.config = argv[++i];
+        } else if (arg == "--out" && hasValue) {
+            options.outDir = argv[++i];
+        } else if (arg == "--scale" && hasValue) {
+            options.scale = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--devices-per-port" && hasValue) {
+            options.devicesPerPort = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--latency" && hasValue) {
+            options.latencyMs = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--error-rate" && hasValue) {
+            options.errorRate = std::atof(argv[++i]);
+        } else if (arg == "--no-pace") {
+            options.pace = false;
+        } else if (arg == "--keep-addresses") {
+            options.keepAddresses = true;
+        } else if (arg == "--fixed-values") {
+            options.fixedValues = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SimulatorOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::ifstream file(options.config);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open serial configuration file: " << options.config << std::endl;
+        return 1;
+    }
+    Json::Value root;
+    file >> root;
+
+    std::string baseDir = ".";
+    size_t slash = options.config.rfind('/');
+    if (slash != std::string::npos) {
+        baseDir = options.config.substr(0, slash);
+    }
+    mkdir(options.outDir.c_str(), 0755);
+
+    std::mt19937 uuidGen(std::random_device{}());
+    std::vector<std::unique_ptr<SimulatedBus>> buses;
+    Json::Value generated = root;
+    generated["devices"] = Json::Value(Json::arrayValue);
+
+    for (const auto& channel : root["devices"]) {
+        std::string clusterFile = baseDir + "/" + channel["uuid"].asString() + ".json";
+        std::ifstream clusterStream(clusterFile);
+        if (!clusterStream.is_open()) {
+            std::cerr << "Failed to open device configuration file: " << clusterFile << std::endl;
+            continue;
+        }
+        Json::Value cluster;
+        clusterStream >> cluster;
+
+        // 按 devices-per-port 把复制出来的设备分到多个伪终端上
+        std::vector<std::unique_ptr<SimulatedBus>> channelBuses;
+        for (int copy = 0; copy < options.scale; ++copy) {
+            for (const auto& device : cluster["devices"]) {
+                if (channelBuses.empty() || channelBuses.back()->full()) {
+                    std::unique_ptr<SimulatedBus> bus(new SimulatedBus(channel, options, uuidGen()));
+                    if (!bus->open()) {
+                        return 1;
+                    }
+                    channelBuses.push_back(std::move(bus));
+                }
+                channelBuses.back()->addDevice(device, uuidGen);
+            }
+        }
+        for (auto& bus : channelBuses) {
+            generated["devices"].append(bus->writeConfig(options.outDir, uuidGen, static_cast<int>(buses.size())));
+            std::cout << channel["alias"].asString() << " -> " << bus->path() << " (" << bus->size() << " devices)" << std::endl;
+            buses.push_back(std::move(bus));
+        }
+    }
+
+    std::ofstream configOut(options.outDir + "/serial_config.json");
+    Json::StreamWriterBuilder writer;
+    configOut << Json::writeString(writer, generated);
+    configOut.close();
+    std::cout << "Configuration written to " << options.outDir << ", run MQTTServer there" << std::endl;
+
+    std::signal(SIGINT, [](int){ running = false; });
+    std::signal(SIGTERM, [](int){ running = false; });
+    for (auto& bus : buses) {
+        bus->start();
+    }
+
+    // 每5秒打印一次汇总
+    while (running.load()) {
+        for (int i = 0; i < 50 && running.load(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        uint64_t requests = 0, responses = 0, pushes = 0, dropped = 0, corrupted = 0;
+        for (const auto& bus : buses) {
+            requests += bus->getStats().requests.load();
+            responses += bus->getStats().responses.load();
+            pushes += bus->getStats().pushes.load();
+            dropped += bus->getStats().dropped.load();
+            corrupted += bus->getStats().corrupted.load();
+        }
+        std::cout << "requests: " << requests << " responses: " << responses << " pushes: " << pushes
+                  << " dropped: " << dropped << " corrupted: " << corrupted << std::endl;
+    }
+    return 0;
+}
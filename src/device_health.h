@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 每个设备的断路器
+// 连续失败（超时、CRC或帧错误）达到 failureThreshold 次后断开，断开期间不再轮询该设备；退避时间到后进入半开状态，
+// 由调用者以低优先级发一次探测，有应答（包括异常应答）则恢复正常轮询，失败则退避时间加倍（不超过 maxBackoffMs）。
+// check/onSuccess/onFailure 只在采集线程调用，statsOf 可在其他线程读取。
+class DeviceHealth {
+public:
+    using ptr = std::shared_ptr<DeviceHealth>;
+    using Clock = std::chrono::steady_clock;
+
+    enum State : uint8_t {
+        Closed,
+        Open,
+        HalfOpen,
+    };
+
+    enum Decision {
+        Poll,   // 正常轮询
+        Probe,  // 半开探测，应排在正常请求之后并单独发送
+        Skip,   // 断开中，本周期不轮询
+    };
+
+    struct DeviceStats {
+        State state;
+        uint32_t consecutiveFailures;
+        uint64_t opens;
+        uint64_t probes;
+        uint64_t busTimeLostUs;
+        int backoffMs;
+    };
+
+    DeviceHealth(size_t devices, uint32_t failureThreshold = 3, int baseBackoffMs = 1000, int maxBackoffMs = 60000)
+        : failureThreshold(failureThreshold > 0 ? failureThreshold : 1), baseBackoffMs(baseBackoffMs),
+          maxBackoffMs(std::max(baseBackoffMs, maxBackoffMs)), slots(devices) {}
+
+    size_t size() const { return slots.size(); }
+
+    Decision check(size_t index, Clock::time_point now) {
+        Slot& slot = slots[index];
+        switch (slot.state.load(std::memory_order_relaxed)) {
+            case Closed:
+                return Poll;
+            case Open:
+                if (now < slot.retryAt) {
+                    return Skip;
+                }
+                slot.state.store(HalfOpen, std::memory_order_relaxed);
+                slot.probes.fetch_add(1, std::memory_order_relaxed);
+                return Probe;
+            default:
+                // 探测被推迟到了下一个周期
+                return Probe;
+        }
+    }
+
+    void onSuccess(size_t index) {
+        Slot& slot = slots[index];
+        slot.state.store(Closed, std::memory_order_relaxed);
+        slot.consecutiveFailures.store(0, std::memory_order_relaxed);
+        slot.backoffMs.store(0, std::memory_order_relaxed);
+    }
+
+    // busTimeUs 为这次失败占用的总线时间
+    void onFailure(size_t index, Clock::time_point now, int64_t busTimeUs) {
+        Slot& slot = slots[index];
+        uint32_t failures = slot.consecutiveFailures.fetch_add(1, std::memory_order_relaxed) + 1;
+        slot.busTimeLostUs.fetch_add(static_cast<uint64_t>(std::max<int64_t>(busTimeUs, 0)), std::memory_order_relaxed);
+
+        State state = slot.state.load(std::memory_order_relaxed);
+        int backoff;
+        if (state == HalfOpen) {
+            backoff = std::min(slot.backoffMs.load(std::memory_order_relaxed) * 2, maxBackoffMs);
+        } else if (state == Closed && failures >= failureThreshold) {
+            backoff = baseBackoffMs;
+        } else {
+            return;
+        }
+        slot.backoffMs.store(backoff, std::memory_order_relaxed);
+        slot.retryAt = now + std::chrono::milliseconds(backoff);
+        slot.state.store(Open, std::memory_order_relaxed);
+        slot.opens.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 重新加载设备列表时沿用同一设备原来的状态和退避时间，断开的设备不会因为重新加载而立即恢复轮询
+    void carryOver(size_t index, const DeviceHealth& from, size_t fromIndex) {
+        Slot& slot = slots[index];
+        const Slot& old = from.slots[fromIndex];
+        slot.state.store(old.state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.consecutiveFailures.store(old.consecutiveFailures.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.opens.store(old.opens.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.probes.store(old.probes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.busTimeLostUs.store(old.busTimeLostUs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.backoffMs.store(old.backoffMs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        slot.retryAt = old.retryAt;
+    }
+
+    DeviceStats statsOf(size_t index) const {
+        const Slot& slot = slots[index];
+        return DeviceStats{
+            slot.state.load(std::memory_order_relaxed),
+            slot.consecutiveFailures.load(std::memory_order_relaxed),
+            slot.opens.load(std::memory_order_relaxed),
+            slot.probes.load(std::memory_order_relaxed),
+            slot.busTimeLostUs.load(std::memory_order_relaxed),
+            slot.backoffMs.load(std::memory_order_relaxed),
+        };
+    }
+
+    static const char* stateName(State state) {
+        switch (state) {
+            case Open: return "open";
+            case HalfOpen: return "half-open";
+            default: return "closed";
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<State> state{Closed};
+        std::atomic<uint32_t> consecutiveFailures{0};
+        std::atomic<uint64_t> opens{0};
+        std::atomic<uint64_t> probes{0};
+        std::atomic<uint64_t> busTimeLostUs{0};
+        std::atomic<int> backoffMs{0};
+        Clock::time_point retryAt;
+    };
+
+    uint32_t failureThreshold;
+    int baseBackoffMs;
+    int maxBackoffMs;
+    std::vector<Slot> slots;
+};
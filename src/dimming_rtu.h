@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "metrics.h"
+#include "modbus_rtu.h"
+#include "push_parser.h"
+#include "serial_reactor.h"
+
+// 调光灯(dimming-rtu)总线协议——占位实现
+// 下面的帧格式是自定的，不是灯具厂商(WIT-ILL-M1)的协议，只有 BusSimulator 能应答；设备配置中的 pan-sid 和
+// group-sid 没有使用，也没有组播/广播寻址，每条命令只发给一个 device-sid + channel。拿到厂商协议文档之前
+// 不要用于生产总线：通道配置中显式写 "dimming-frame":"placeholder" 才启用，否则 dimming-rtu 通道仍用模拟数据。
+// 命令帧(12字节)：A5 | 长度(8) | device-sid(4) | channel | 操作码 | 序号 | 亮度 | CRC16(低字节在前)
+// 应答帧(13字节)：A5 | 长度(9) | device-sid(4) | channel | 操作码|0x80 | 序号 | 状态 | 亮度 | CRC16
+// 操作码 01 设置亮度，02 查询亮度；状态 0 表示成功，应答中的亮度为灯当前亮度(0~100)
+enum DimmingOpcode : uint8_t {
+    DIMMING_SET_LEVEL = 0x01,
+    DIMMING_QUERY_LEVEL = 0x02,
+};
+
+// 解析 "84.14.00.22 H" 形式的十六进制地址
+inline bool parseDimmingSid(const std::string& text, uint8_t sid[4]) {
+    std::string digits = text.substr(0, text.find(' '));
+    std::stringstream ss(digits);
+    std::string part;
+    int count = 0;
+    while (std::getline(ss, part, '.')) {
+        if (count >= 4 || part.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        long value = std::strtol(part.c_str(), &end, 16);
+        if (*end != '\0' || value < 0 || value > 0xFF) {
+            return false;
+        }
+        sid[count++] = static_cast<uint8_t>(value);
+    }
+    return count == 4;
+}
+
+// 调光灯驱动
+// 命令不逐条等待应答，而是连续写到总线上（最多 window 条在途），应答由串口的上报数据流异步匹配序号，
+// 超时的命令重发，重发次数用尽后报告失败。
+class DimmingDriver : public SerialStreamReader {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // uuid 为目标设备，应答回来时按 uuid 找设备，期间设备列表可能已经重新加载
+    struct Command {
+        std::string uuid;
+        uint8_t sid[4] = {0, 0, 0, 0};
+        uint8_t channel = 0;
+        uint8_t opcode = DIMMING_SET_LEVEL;
+        uint8_t level = 0;
+    };
+
+    // ok 为false表示重发后仍无应答或从站返回错误；level 为应答中的当前亮度
+    using AckHandler = std::function<void(const Command& command, bool ok, uint8_t level)>;
+
+    struct Stats {
+        std::atomic<uint64_t> sent{0};
+        std::atomic<uint64_t> acked{0};
+        std::atomic<uint64_t> retries{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> crcErrors{0};
+        std::atomic<uint64_t> strayAcks{0};
+        Histogram ackLatencyUs;
+    };
+
+    DimmingDriver(SerialReactor& reactor, int portId, const SerialPortConfig& config, const AckHandler& handler,
+                  size_t window = 64, int maxRetries = 2)
+        : reactor(reactor), portId(portId), handler(handler), window(window > 0 && window < 256 ? window : 64),
+          maxRetries(maxRetries), nextSequence(0) {
+        // 应答超时 = 在途命令全部发完的时间 + 应答本身的传输时间 + 从站响应时间
+        ackTimeout = std::chrono::microseconds(config.charsToMicros(static_cast<double>((kCommandLength + kAckLength) * this->window)) +
+                                               config.responseTimeoutMs * 1000);
+    }
+
+    // 提交一批命令（线程安全），在途窗口满时在驱动内排队
+    void submit(const std::vector<Command>& commands) {
+        std::vector<uint8_t> burst;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& command : commands) {
+                backlog.push_back(command);
+            }
+            fillWindow(burst);
+        }
+        flush(burst);
+    }
+
+    // 检查应答超时，由采集线程周期性调用
+    void expire(Clock::time_point now) {
+        std::vector<uint8_t> burst;
+        std::vector<Command> failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& slot : inFlight) {
+                if (!slot.used || now - slot.sentAt < ackTimeout) {
+                    continue;
+                }
+                if (slot.attempts <= maxRetries) {
+                    stats.retries.fetch_add(1, std::memory_order_relaxed);
+                    encode(slot, burst);
+                } else {
+                    stats.failures.fetch_add(1, std::memory_order_relaxed);
+                    failed.push_back(slot.command);
+                    slot.used = false;
+                    --inFlightCount;
+                }
+            }
+            fillWindow(burst);
+        }
+        flush(burst);
+        for (const auto& command : failed) {
+            handler(command, false, 0);
+        }
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlightCount + backlog.size();
+    }
+
+    ssize_t readFrom(int fd) override {
+        ssize_t n = ring.readFrom(fd);
+        if (n > 0) {
+            parse();
+        } else if (ring.space() == 0) {
+            ring.consume(ring.size());
+        }
+        return n;
+    }
+
+    void onSilence() override {
+        // 不完整的应答在静默后丢弃
+        ring.consume(ring.size());
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    enum { kCommandLength = 12, kAckLength = 13 };
+
+    struct Slot {
+        bool used = false;
+        int attempts = 0;
+        Command command;
+        Clock::time_point sentAt;
+        Clock::time_point firstSentAt;
+    };
+
+    SerialReactor& reactor;
+    int portId;
+    AckHandler handler;
+    size_t window;
+    int maxRetries;
+    Clock::duration ackTimeout;
+
+    std::mutex mutex;
+    std::deque<Command> backlog;
+    Slot inFlight[256];
+    size_t inFlightCount = 0;
+    uint8_t nextSequence;
+
+    ByteRing<1024> ring;
+    Stats stats;
+
+    // 在窗口允许的范围内为排队的命令分配序号并编码，需持有mutex
+    void fillWindow(std::vector<uint8_t>& burst) {
+        while (!backlog.empty() && inFlightCount < window) {
+            while (inFlight[nextSequence].used) {
+                ++nextSequence;
+            }
+            Slot& slot = inFlight[nextSequence];
+            slot.used = true;
+            slot.attempts = 0;
+            slot.command = backlog.front();
+            slot.firstSentAt = Clock::now();
+            backlog.pop_front();
+            ++inFlightCount;
+            ++nextSequence;
+            encode(slot, burst);
+        }
+    }
+
+    void encode(Slot& slot, std::vector<uint8_t>& burst) {
+        const Command& command = slot.command;
+        size_t start = burst.size();
+        burst.push_back(0xA5);
+        burst.push_back(8);
+        burst.insert(burst.end(), command.sid, command.sid + 4);
+        burst.push_back(command.channel);
+        burst.push_back(command.opcode);
+        burst.push_back(static_cast<uint8_t>(&slot - inFlight));
+        burst.push_back(command.level);
+        uint16_t crc = modbusCrc16(burst.data() + start, burst.size() - start);
+        burst.push_back(static_cast<uint8_t>(crc & 0xFF));
+        burst.push_back(static_cast<uint8_t>(crc >> 8));
+        slot.sentAt = Clock::now();
+        ++slot.attempts;
+        stats.sent.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush(std::vector<uint8_t>& burst) {
+        if (!burst.empty()) {
+            reactor.send(portId, burst);
+        }
+    }
+
+    void parse() {
+        while (ring.size() >= kAckLength) {
+            if (ring.at(0) != 0xA5 || ring.at(1) != kAckLength - 4) {
+                ring.consume(1);
+                continue;
+            }
+            uint16_t crc = 0xFFFF;
+            for (size_t i = 0; i < kAckLength - 2; ++i) {
+                crc = modbusCrcUpdate(crc, ring.at(i));
+            }
+            if (ring.at(kAckLength - 2) != (crc & 0xFF) || ring.at(kAckLength - 1) != (crc >> 8)) {
+                stats.crcErrors.fetch_add(1, std::memory_order_relaxed);
+                ring.consume(1);
+                continue;
+            }
+            onAck(ring.at(8), ring.at(9), ring.at(10), ring.at(7));
+            ring.consume(kAckLength);
+        }
+    }
+
+    void onAck(uint8_t sequence, uint8_t status, uint8_t level, uint8_t opcode) {
+        Command command;
+        bool matched = false;
+        std::vector<uint8_t> burst;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Slot& slot = inFlight[sequence];
+            if (slot.used && (slot.command.opcode | 0x80) == opcode) {
+                matched = true;
+                command = slot.command;
+                slot.used = false;
+                --inFlightCount;
+                stats.ackLatencyUs.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - slot.firstSentAt).count());
+                fillWindow(burst);
+            }
+        }
+        flush(burst);
+
+        if (!matched) {
+            stats.strayAcks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (status == 0) {
+            stats.acked.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            stats.failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        handler(command, status == 0, level);
+    }
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 文件写入参数，对应 serial_config.json 中的 files 块
+struct FileSinkConfig {
+    std::string directory = ".";
+    size_t maxOpenFiles = 64;
+    size_t bufferBytes = 64 * 1024;
+    int flushIntervalMs = 1000;
+};
+
+// 按文件名追加写入的文件输出
+// 每个文件在内存中攒数据，缓冲区满、距上次写出超过 flushIntervalMs 或关闭时才 write 一次；
+// 缓冲区属于文件本身，与是否打开无关。写出时才需要文件描述符，同时打开的文件数不超过 maxOpenFiles，
+// 超过时只关闭最久没有写出的文件（LRU），不把它的缓冲区提前写出，下次写出时再重新打开。
+// 设备数超过 maxOpenFiles 时每次写出最多多一次 open/close，而不是每条数据一次。
+class FileSink {
+public:
+    using ptr = std::shared_ptr<FileSink>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint64_t> appends{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> writes{0};
+        std::atomic<uint64_t> opens{0};
+        std::atomic<uint64_t> closes{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> errors{0};
+    };
+
+    explicit FileSink(const FileSinkConfig& config = FileSinkConfig())
+        : config(config), lastSweep(Clock::now()) {
+        if (this->config.maxOpenFiles == 0) {
+            this->config.maxOpenFiles = 1;
+        }
+    }
+
+    ~FileSink() {
+        flushAll();
+        while (!lru.empty()) {
+            closeFile(lru.back());
+        }
+    }
+
+    // 线程安全
+    void append(const std::string& name, const char* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = Clock::now();
+        File& file = fileFor(name, now);
+        file.buffer.append(data, size);
+        stats.appends.fetch_add(1, std::memory_order_relaxed);
+        stats.bytes.fetch_add(size, std::memory_order_relaxed);
+        if (file.buffer.size() >= config.bufferBytes) {
+            writeOut(file, now);
+        }
+        if (now - lastSweep >= std::chrono::milliseconds(config.flushIntervalMs)) {
+            flushOlderThan(now - std::chrono::milliseconds(config.flushIntervalMs), now);
+            lastSweep = now;
+        }
+    }
+
+    void append(const std::string& name, const std::string& data) {
+        append(name, data.data(), data.size());
+    }
+
+    // 写出距上次写出超过 flushIntervalMs 的文件
+    void flushDue() {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = Clock::now();
+        flushOlderThan(now - std::chrono::milliseconds(config.flushIntervalMs), now);
+        lastSweep = now;
+    }
+
+    void flushAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        flushOlderThan(Clock::time_point::max(), Clock::now());
+    }
+
+    size_t openFiles() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lru.size();
+    }
+
+    const FileSinkConfig& getConfig() const { return config; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    // 文件的缓冲区和打开状态；fd 为-1时不在 lru 中
+    struct File {
+        std::string path;
+        int fd = -1;
+        std::string buffer;
+        Clock::time_point lastWrite;
+        std::list<File*>::iterator lru;
+    };
+
+    FileSinkConfig config;
+    std::mutex mutex;
+    // 每个写过的文件一项，文件名数量与设备数相同，不会无限增长
+    std::unordered_map<std::string, File> files;
+    // 已打开的文件，头部为最近写出的
+    std::list<File*> lru;
+    Clock::time_point lastSweep;
+    Stats stats;
+
+    File& fileFor(const std::string& name, Clock::time_point now) {
+        auto it = files.find(name);
+        if (it != files.end()) {
+            return it->second;
+        }
+        File& file = files[name];
+        file.path = config.directory + "/" + name;
+        file.lastWrite = now;
+        return file;
+    }
+
+    // 写出前保证文件已打开，打开的文件数已满时关闭最久没有写出的一个
+    bool ensureOpen(File& file) {
+        if (file.fd >= 0) {
+            lru.splice(lru.begin(), lru, file.lru);
+            return true;
+        }
+        while (lru.size() >= config.maxOpenFiles) {
+            closeFile(lru.back());
+            stats.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        file.fd = ::open(file.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        stats.opens.fetch_add(1, std::memory_order_relaxed);
+        if (file.fd < 0) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "Failed to open " << file.path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        lru.push_front(&file);
+        file.lru = lru.begin();
+        return true;
+    }
+
+    void closeFile(File* file) {
+        ::close(file->fd);
+        file->fd = -1;
+        lru.erase(file->lru);
+        stats.closes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flushOlderThan(Clock::time_point threshold, Clock::time_point now) {
+        for (auto& kv : files) {
+            if (!kv.second.buffer.empty() && kv.second.lastWrite <= threshold) {
+                writeOut(kv.second, now);
+            }
+        }
+    }
+
+    void writeOut(File& file, Clock::time_point now) {
+        file.lastWrite = now;
+        if (file.buffer.empty()) {
+            return;
+        }
+        if (ensureOpen(file)) {
+            const char* data = file.buffer.data();
+            size_t remaining = file.buffer.size();
+            while (remaining > 0) {
+                ssize_t n = ::write(file.fd, data, remaining);
+                stats.writes.fetch_add(1, std::memory_order_relaxed);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    stats.errors.fetch_add(1, std::memory_order_relaxed);
+                    std::cerr << "Failed to write history file: " << std::strerror(errno) << std::endl;
+                    break;
+                }
+                data += n;
+                remaining -= static_cast<size_t>(n);
+            }
+        }
+        file.buffer.clear();
+    }
+};
@@ -0,0 +1,144 @@
+// 历史文件写入微基准
+// 对比原来每条采样 打开文件 - 每行flush - 关闭 的写法与 FileSink（文件保持打开、缓冲后批量写出）
+// 每条采样的耗时、write 系统调用次数（来自 /proc/self/io 的 syscw）和 open/close 次数，以及经过后台写线程时采集线程一侧的耗时。
+// --max-open 小于 --devices 时可以看到打开文件数受限时的 open/close 次数。
+// 在指定目录下生成 bench-*.txt。
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "file_writer.h"
+
+struct BenchOptions {
+    std::string directory = "/tmp";
+    int devices = 200;
+    int samples = 100000;
+    size_t maxOpenFiles = 256;
+};
+
+// 当前进程累计的 write 类系统调用次数
+uint64_t writeSyscalls() {
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value) {
+        if (key == "syscw:") {
+            return value;
+        }
+    }
+    return 0;
+}
+
+// 与 DataAcquire 写出的内容相同：每条采样4行
+std::string sampleLines(int i) {
+    return "humidity: " + std::to_string(40 + i % 20) + "\n"
+           "temperature: " + std::to_string(20 + i % 10) + ".5\n"
+           "timestamp: 2024-01-01T00:00:00Z\n"
+           "uuid: bench-" + std::to_string(i) + "\n";
+}
+
+std::string fileOf(const BenchOptions& options, int i) {
+    return "bench-" + std::to_string(i % options.devices) + ".txt";
+}
+
+void report(const char* name, const BenchOptions& options, std::chrono::steady_clock::time_point begin, uint64_t syscalls,
+            uint64_t opens, uint64_t closes) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << name << ": " << seconds * 1e9 / options.samples << " ns/sample, "
+              << static_cast<double>(syscalls) / options.samples << " write syscalls/sample, "
+              << opens << " opens, " << closes << " closes" << std::endl;
+}
+
+void benchOfstream(const BenchOptions& options) {
+    uint64_t before = writeSyscalls();
+    uint64_t opens = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.samples; ++i) {
+        ++opens;
+        std::ofstream dataFile(options.directory + "/" + fileOf(options, i), std::ios::out | std::ios::app);
+        std::string lines = sampleLines(i);
+        size_t start = 0;
+        size_t end;
+        while ((end = lines.find('\n', start)) != std::string::npos) {
+            dataFile << lines.substr(start, end - start) << std::endl;
+            dataFile.flush();
+            start = end + 1;
+        }
+        dataFile.close();
+    }
+    report("ofstream per sample", options, begin, writeSyscalls() - before, opens, opens);
+}
+
+void benchFileSink(const BenchOptions& options) {
+    FileSinkConfig config;
+    config.directory = options.directory;
+    config.maxOpenFiles = options.maxOpenFiles;
+    uint64_t before = writeSyscalls();
+    uint64_t opens = 0, closes = 0;
+    auto begin = std::chrono::steady_clock::now();
+    {
+        FileSink sink(config);
+        for (int i = 0; i < options.samples; ++i) {
+            sink.append(fileOf(options, i), sampleLines(i));
+        }
+        sink.flushAll();
+        const FileSink::Stats& stats = sink.getStats();
+        std::cout << "FileSink evictions " << stats.evictions.load() << ", writes " << stats.writes.load() << std::endl;
+        opens = stats.opens.load();
+        // 析构时关闭剩下的文件
+        closes = stats.closes.load() + sink.openFiles();
+    }
+    report("FileSink", options, begin, writeSyscalls() - before, opens, closes);
+}
+
+// 采集线程只入队，耗时只算到入队完成为止；写线程的写出在 stop 中等待完成
+void benchFileWriter(const BenchOptions& options) {
+    FileSinkConfig config;
+    config.directory = options.directory;
+    config.maxOpenFiles = options.maxOpenFiles;
+    FileWriter writer(config);
+    writer.start();
+    std::vector<std::string> lines;
+    lines.reserve(options.samples);
+    for (int i = 0; i < options.samples; ++i) {
+        lines.push_back(sampleLines(i));
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.samples; ++i) {
+        writer.append(fileOf(options, i), std::move(lines[i]));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    writer.stop();
+    const FileWriter::Stats& stats = writer.getStats();
+    const FileSink::Stats& sinkStats = writer.getSink()->getStats();
+    std::cout << "FileWriter: " << seconds * 1e9 / options.samples << " ns/sample on the producer, "
+              << stats.batches.load() << " batches, max lag " << stats.lagHistogramUs.toJson()["max"].asUInt64() << " us, "
+              << sinkStats.opens.load() << " opens, " << sinkStats.closes.load() << " closes" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--dir" && hasValue) {
+            options.directory = argv[++i];
+        } else if (arg == "--devices" && hasValue) {
+            options.devices = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--samples" && hasValue) {
+            options.samples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--max-open" && hasValue) {
+            options.maxOpenFiles = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            std::cout << "Usage: FileSinkBench [--dir DIR] [--devices N] [--samples N] [--max-open N]" << std::endl;
+            return 1;
+        }
+    }
+    benchOfstream(options);
+    benchFileSink(options);
+    benchFileWriter(options);
+    return 0;
+}
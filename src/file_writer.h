@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "concurrentqueue.h"
+#include "file_sink.h"
+#include "metrics.h"
+#include "segment.h"
+
+// 所有通道共用的后台文件写线程
+// 采集线程只把 (文件名, 数据) 放进无锁队列就返回，不会因为磁盘慢而拉长采集周期；
+// 写线程批量取出，同一文件的数据拼接后一次交给 FileSink，空闲时按 flushIntervalMs 写出到期的缓冲区。
+// 配置了 SegmentStore 时，appendSample 的定长采样由同一个线程写入设备的分列文件。
+// 写线程启动前（或停止后）直接同步写入。
+class FileWriter {
+public:
+    using ptr = std::shared_ptr<FileWriter>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint64_t> enqueued{0};
+        std::atomic<uint64_t> dequeued{0};
+        std::atomic<uint64_t> batches{0};
+        // 最近一批中最老一条从入队到交给 FileSink 的时间
+        std::atomic<uint64_t> lagUs{0};
+        Histogram batchSize;
+        Histogram lagHistogramUs;
+    };
+
+    // text 为 false 时不写txt文件，segments 为空时不写分列文件
+    explicit FileWriter(const FileSinkConfig& config = FileSinkConfig(), bool text = true,
+                        const SegmentStore::ptr& segments = nullptr)
+        : sink(std::make_shared<FileSink>(config)), segments(segments), text(text), running(false),
+          writeRequests(0), writtenRequests(0) {}
+
+    ~FileWriter() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    // 停止前写完队列中剩下的数据并写出所有缓冲区
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+        drain();
+        sink->flushAll();
+        if (segments) {
+            std::lock_guard<std::mutex> lock(segmentMutex);
+            segments->flushAll();
+        }
+    }
+
+    // 可在任意线程调用，不阻塞
+    void append(std::string name, std::string data) {
+        if (!running.load(std::memory_order_relaxed)) {
+            sink->append(name, data);
+            return;
+        }
+        queue.enqueue(Record{std::move(name), std::move(data), Clock::now(), nullptr, 0});
+        stats.enqueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 一条采样追加到设备的分列文件，values 依次对应 fields
+    void appendSample(const std::string& uuid, const SegmentFields& fields, int64_t timeMs, const double* values, size_t count) {
+        if (!running.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(segmentMutex);
+            segments->append(uuid, fields, timeMs, values, count);
+            return;
+        }
+        std::string data(reinterpret_cast<const char*>(values), count * sizeof(double));
+        queue.enqueue(Record{uuid, std::move(data), Clock::now(), fields, timeMs});
+        stats.enqueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 等到调用时刻之前入队的txt数据都已 write 到文件，超时返回false。分列文件的块不提前写出。
+    // 写线程未运行时 append 已经同步写入缓冲区，这里直接写出
+    bool waitWritten(int timeoutMs) {
+        if (!running.load()) {
+            sink->flushAll();
+            return true;
+        }
+        uint64_t ticket = writeRequests.fetch_add(1) + 1;
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (writtenRequests.load() < ticket) {
+            if (Clock::now() >= deadline || !running.load()) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // 见 SegmentStore::pendingSince；没有分列文件时为 time_point::max()
+    Clock::time_point segmentsPendingSince() {
+        if (!segments) {
+            return Clock::time_point::max();
+        }
+        std::lock_guard<std::mutex> lock(segmentMutex);
+        return segments->pendingSince();
+    }
+
+    bool writesText() const { return text; }
+    bool writesSegments() const { return segments != nullptr; }
+
+    size_t depth() const { return queue.size_approx(); }
+    const FileSink::ptr& getSink() const { return sink; }
+    const SegmentStore::ptr& getSegments() const { return segments; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Record {
+        std::string name;
+        std::string data;
+        Clock::time_point enqueuedAt;
+        // 非空时为采样，data 为 count 个 double
+        SegmentFields fields;
+        int64_t timeMs;
+    };
+
+    enum { kBulk = 256, kIdleMs = 5 };
+
+    FileSink::ptr sink;
+    SegmentStore::ptr segments;
+    // 写线程之外（启动前、停止后）也可能写分列文件
+    std::mutex segmentMutex;
+    bool text;
+    moodycamel::ConcurrentQueue<Record> queue;
+    std::atomic<bool> running;
+    // waitWritten 的请求序号和写线程已完成的序号
+    std::atomic<uint64_t> writeRequests;
+    std::atomic<uint64_t> writtenRequests;
+    std::thread worker;
+    Stats stats;
+    Record records[kBulk];
+    // 一批中按文件名合并的数据，循环复用
+    std::unordered_map<std::string, std::string> pending;
+    std::vector<double> sampleValues;
+
+    void run() {
+        auto nextFlush = Clock::now();
+        while (running.load(std::memory_order_relaxed)) {
+            // 先读请求序号再取队列，请求之前入队的数据都在这次 drain 中
+            uint64_t request = writeRequests.load();
+            size_t n = drain();
+            if (request != writtenRequests.load(std::memory_order_relaxed)) {
+                sink->flushAll();
+                writtenRequests.store(request);
+            }
+            auto now = Clock::now();
+            if (now >= nextFlush) {
+                sink->flushDue();
+                if (segments) {
+                    std::lock_guard<std::mutex> lock(segmentMutex);
+                    segments->flushDue();
+                }
+                nextFlush = now + std::chrono::milliseconds(std::max(sink->getConfig().flushIntervalMs / 4, 1));
+            }
+            if (n == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMs));
+            }
+        }
+    }
+
+    // 取出队列中当前所有数据，返回条数
+    size_t drain() {
+        size_t total = 0;
+        size_t n;
+        while ((n = queue.try_dequeue_bulk(records, kBulk)) > 0) {
+            auto oldest = records[0].enqueuedAt;
+            for (size_t i = 0; i < n; ++i) {
+                oldest = std::min(oldest, records[i].enqueuedAt);
+                if (records[i].fields) {
+                    sampleValues.resize(records[i].data.size() / sizeof(double));
+                    std::memcpy(sampleValues.data(), records[i].data.data(), sampleValues.size() * sizeof(double));
+                    std::lock_guard<std::mutex> lock(segmentMutex);
+                    segments->append(records[i].name, records[i].fields, records[i].timeMs, sampleValues.data(), sampleValues.size());
+                    records[i].fields.reset();
+                    continue;
+                }
+                std::string& data = pending[records[i].name];
+                if (data.empty()) {
+                    data.swap(records[i].data);
+                } else {
+                    data.append(records[i].data);
+                }
+            }
+            for (auto& kv : pending) {
+                if (!kv.second.empty()) {
+                    sink->append(kv.first, kv.second);
+                    kv.second.clear();
+                }
+            }
+            uint64_t lag = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - oldest).count());
+            stats.lagUs.store(lag, std::memory_order_relaxed);
+            stats.lagHistogramUs.record(lag);
+            stats.batchSize.record(n);
+            stats.batches.fetch_add(1, std::memory_order_relaxed);
+            stats.dequeued.fetch_add(n, std::memory_order_relaxed);
+            total += n;
+        }
+        if (pending.size() > 4 * static_cast<size_t>(kBulk)) {
+            pending.clear();
+        }
+        return total;
+    }
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Gorilla 时间序列压缩（Facebook Gorilla 论文的编码）
+// 时间戳：第一个64位原样保存，之后保存 delta-of-delta：
+//   0 -> '0'，[-64,63] -> '10'+7位，[-256,255] -> '110'+9位，[-2048,2047] -> '1110'+12位，其余 '1111'+64位（补码）
+// 值：第一个double原样保存，之后与前一个值的位模式异或：
+//   相同 -> '0'；有效位落在上一次的前导零/后缀零窗口内 -> '10'+有效位；
+//   否则 '11'+5位前导零个数+6位有效位长度(64记为0)+有效位
+// 采样周期固定、数值变化慢的传感器数据大多数时间戳只占1位，值占十几位。
+
+// 按位追加，高位在前；acc 中只有低 used 位（不足一个字节）还没写出
+class BitWriter {
+public:
+    BitWriter() : acc(0), used(0) {}
+
+    // count 不超过64
+    void write(uint64_t bits, int count) {
+        if (count > 32) {
+            write(bits >> 32, count - 32);
+            count = 32;
+        }
+        acc = (acc << count) | (bits & ((1ull << count) - 1));
+        used += count;
+        while (used >= 8) {
+            used -= 8;
+            out.push_back(static_cast<char>(acc >> used));
+        }
+    }
+
+    // 补齐最后一个字节后返回编码结果
+    const std::string& finish() {
+        if (used > 0) {
+            out.push_back(static_cast<char>(acc << (8 - used)));
+            used = 0;
+        }
+        return out;
+    }
+
+    void clear() {
+        out.clear();
+        acc = 0;
+        used = 0;
+    }
+
+private:
+    std::string out;
+    uint64_t acc;
+    int used;
+};
+
+class BitReader {
+public:
+    BitReader(const char* data, size_t size) : data(reinterpret_cast<const uint8_t*>(data)), size(size), pos(0), acc(0), available(0) {}
+
+    // count 不超过64；读到末尾之后补0，由 overflow() 判断
+    uint64_t read(int count) {
+        if (count > 32) {
+            uint64_t high = read(count - 32);
+            return (high << 32) | read(32);
+        }
+        while (available < count) {
+            acc = (acc << 8) | (pos < size ? data[pos] : 0);
+            ++pos;
+            available += 8;
+        }
+        available -= count;
+        return (acc >> available) & ((1ull << count) - 1);
+    }
+
+    bool readBit() {
+        return read(1) != 0;
+    }
+
+    // 读取的位数超过了数据长度
+    bool overflow() const { return pos * 8 - static_cast<size_t>(available) > size * 8; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    int available;
+};
+
+inline int countLeadingZeros(uint64_t value) {
+    return value == 0 ? 64 : __builtin_clzll(value);
+}
+
+inline int countTrailingZeros(uint64_t value) {
+    return value == 0 ? 64 : __builtin_ctzll(value);
+}
+
+inline void encodeGorillaTimes(const int64_t* times, size_t count, BitWriter& writer) {
+    int64_t previous = 0;
+    int64_t previousDelta = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i == 0) {
+            writer.write(static_cast<uint64_t>(times[0]), 64);
+            previous = times[0];
+            continue;
+        }
+        int64_t delta = times[i] - previous;
+        int64_t dod = delta - previousDelta;
+        if (dod == 0) {
+            writer.write(0, 1);
+        } else if (dod >= -64 && dod <= 63) {
+            writer.write(0x2, 2);
+            writer.write(static_cast<uint64_t>(dod), 7);
+        } else if (dod >= -256 && dod <= 255) {
+            writer.write(0x6, 3);
+            writer.write(static_cast<uint64_t>(dod), 9);
+        } else if (dod >= -2048 && dod <= 2047) {
+            writer.write(0xe, 4);
+            writer.write(static_cast<uint64_t>(dod), 12);
+        } else {
+            writer.write(0xf, 4);
+            writer.write(static_cast<uint64_t>(dod), 64);
+        }
+        previousDelta = delta;
+        previous = times[i];
+    }
+}
+
+// n 位补码还原为有符号数
+inline int64_t signExtend(uint64_t value, int bits) {
+    return bits == 64 ? static_cast<int64_t>(value) : static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+}
+
+inline bool decodeGorillaTimes(const char* data, size_t size, size_t count, int64_t* times) {
+    BitReader reader(data, size);
+    int64_t previous = 0;
+    int64_t previousDelta = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i == 0) {
+            previous = static_cast<int64_t>(reader.read(64));
+            times[0] = previous;
+            continue;
+        }
+        int64_t dod = 0;
+        if (reader.readBit()) {
+            if (!reader.readBit()) {
+                dod = signExtend(reader.read(7), 7);
+            } else if (!reader.readBit()) {
+                dod = signExtend(reader.read(9), 9);
+            } else if (!reader.readBit()) {
+                dod = signExtend(reader.read(12), 12);
+            } else {
+                dod = static_cast<int64_t>(reader.read(64));
+            }
+        }
+        previousDelta += dod;
+        previous += previousDelta;
+        times[i] = previous;
+    }
+    return !reader.overflow();
+}
+
+inline uint64_t doubleBits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline void encodeGorillaValues(const double* values, size_t count, BitWriter& writer) {
+    uint64_t previous = 0;
+    int leading = -1;
+    int trailing = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t bits = doubleBits(values[i]);
+        if (i == 0) {
+            writer.write(bits, 64);
+            previous = bits;
+            continue;
+        }
+        uint64_t x = bits ^ previous;
+        previous = bits;
+        if (x == 0) {
+            writer.write(0, 1);
+            continue;
+        }
+        int lz = countLeadingZeros(x);
+        int tz = countTrailingZeros(x);
+        if (lz > 31) {
+            lz = 31;
+        }
+        if (leading >= 0 && lz >= leading && tz >= trailing) {
+            writer.write(0x2, 2);
+            writer.write(x >> trailing, 64 - leading - trailing);
+        } else {
+            int length = 64 - lz - tz;
+            writer.write(0x3, 2);
+            writer.write(static_cast<uint64_t>(lz), 5);
+            writer.write(static_cast<uint64_t>(length & 63), 6);
+            writer.write(x >> tz, length);
+            leading = lz;
+            trailing = tz;
+        }
+    }
+}
+
+inline bool decodeGorillaValues(const char* data, size_t size, size_t count, double* values) {
+    BitReader reader(data, size);
+    uint64_t previous = 0;
+    int leading = 0;
+    int trailing = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0 && reader.readBit()) {
+            if (reader.readBit()) {
+                leading = static_cast<int>(reader.read(5));
+                int length = static_cast<int>(reader.read(6));
+                if (length == 0) {
+                    length = 64;
+                }
+                trailing = 64 - leading - length;
+                if (trailing < 0) {
+                    return false;
+                }
+            }
+            previous ^= reader.read(64 - leading - trailing) << trailing;
+        } else if (i == 0) {
+            previous = reader.read(64);
+        }
+        std::memcpy(&values[i], &previous, sizeof(previous));
+    }
+    return !reader.overflow();
+}
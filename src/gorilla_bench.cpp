@@ -0,0 +1,148 @@
+// Gorilla 编码微基准
+// 对模拟的传感器序列（固定周期带少量抖动的时间戳，缓慢变化、保留1~2位小数的温湿度/CO2/亮度）测编码、解码吞吐和压缩率；
+// --file 指定 .seg 文件时改用其中记录的数据。
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "gorilla.h"
+#include "segment.h"
+
+struct Series {
+    std::string name;
+    std::vector<int64_t> times;
+    std::vector<double> values;
+};
+
+std::vector<Series> simulate(size_t samples) {
+    std::mt19937 rng(42);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::vector<int64_t> times(samples);
+    int64_t t = 1700000000000;
+    for (size_t i = 0; i < samples; ++i) {
+        // acquisition-cycle 1000ms，采集时刻有几毫秒抖动
+        times[i] = t + static_cast<int64_t>(rng() % 5);
+        t += 1000;
+    }
+    std::vector<Series> series;
+    const char* names[] = {"temperature", "humidity", "co2", "percentage"};
+    double levels[] = {22.0, 45.0, 420.0, 80.0};
+    double scales[] = {100.0, 10.0, 1.0, 1.0};
+    for (int s = 0; s < 4; ++s) {
+        Series item{names[s], times, std::vector<double>(samples)};
+        double level = levels[s];
+        for (size_t i = 0; i < samples; ++i) {
+            if (s == 3) {
+                // 调光亮度大部分时间不变
+                if (rng() % 500 == 0) {
+                    level = static_cast<double>(rng() % 101);
+                }
+            } else {
+                level += noise(rng) * 0.02 * levels[s] / 20;
+            }
+            item.values[i] = std::round(level * scales[s]) / scales[s];
+        }
+        series.push_back(item);
+    }
+    return series;
+}
+
+bool load(const std::string& path, std::vector<Series>& series) {
+    SegmentReader reader;
+    if (!reader.open(path)) {
+        std::cerr << path << ": " << reader.getError() << std::endl;
+        return false;
+    }
+    std::vector<int> columns;
+    for (size_t i = 0; i < reader.getFields().size(); ++i) {
+        columns.push_back(static_cast<int>(i));
+    }
+    std::vector<int64_t> times;
+    std::vector<std::vector<double>> values;
+    if (!reader.read(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), columns, times, values)) {
+        std::cerr << path << ": " << reader.getError() << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < columns.size(); ++i) {
+        series.push_back(Series{reader.getFields()[i], times, values[i]});
+    }
+    return !times.empty();
+}
+
+int main(int argc, char* argv[]) {
+    size_t samples = 1000000;
+    size_t blockSamples = 128;
+    std::string file;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--samples" && hasValue) {
+            samples = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--block" && hasValue) {
+            blockSamples = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--file" && hasValue) {
+            file = argv[++i];
+        } else {
+            std::cout << "Usage: GorillaBench [--samples N] [--block N] [--file FILE.seg]" << std::endl;
+            return 1;
+        }
+    }
+    std::vector<Series> series;
+    if (!file.empty()) {
+        if (!load(file, series)) {
+            return 1;
+        }
+    } else {
+        series = simulate(samples);
+    }
+
+    // 与分列文件相同，每 blockSamples 条单独编码
+    BitWriter writer;
+    for (size_t s = 0; s <= series.size(); ++s) {
+        bool timeColumn = s == series.size();
+        const Series& item = series[timeColumn ? 0 : s];
+        size_t n = item.times.size();
+        std::vector<std::string> blocks;
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < n; i += blockSamples) {
+            size_t count = std::min(blockSamples, n - i);
+            writer.clear();
+            if (timeColumn) {
+                encodeGorillaTimes(item.times.data() + i, count, writer);
+            } else {
+                encodeGorillaValues(item.values.data() + i, count, writer);
+            }
+            blocks.push_back(writer.finish());
+            bytes += blocks.back().size();
+        }
+        double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::vector<int64_t> times(blockSamples);
+        std::vector<double> values(blockSamples);
+        bool ok = true;
+        begin = std::chrono::steady_clock::now();
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            size_t count = std::min(blockSamples, n - b * blockSamples);
+            if (timeColumn) {
+                ok = decodeGorillaTimes(blocks[b].data(), blocks[b].size(), count, times.data()) &&
+                     std::memcmp(times.data(), item.times.data() + b * blockSamples, count * 8) == 0 && ok;
+            } else {
+                ok = decodeGorillaValues(blocks[b].data(), blocks[b].size(), count, values.data()) &&
+                     std::memcmp(values.data(), item.values.data() + b * blockSamples, count * 8) == 0 && ok;
+            }
+        }
+        double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        std::cout << (timeColumn ? std::string("captured-at") : item.name) << ": " << n << " samples, "
+                  << bytes * 8.0 / n << " bits/sample, ratio " << n * 8.0 / bytes
+                  << ", encode " << n / encodeSeconds / 1e6 << " M/s, decode " << n / decodeSeconds / 1e6 << " M/s"
+                  << (ok ? "" : " ROUNDTRIP MISMATCH") << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "metrics.h"
+#include "redis_pool.h"
+#include "sample.h"
+
+// redis 最新值的写回缓存
+// 采集线程只覆盖设备在表中的槽位并标记为脏，写线程每隔 intervalMs 只把脏槽位写出一次：
+// 设备采样再快，最新值的写入量也不超过 设备数 x 刷新频率，中间被覆盖的值不再写redis。
+// json 存储为每个设备一条 SET；hash 存储按字段记录，只写出上次刷新后变化的字段。
+class LatestValueCache {
+public:
+    using ptr = std::shared_ptr<LatestValueCache>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint64_t> updates{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> flushes{0};
+        std::atomic<uint64_t> slotsWritten{0};
+        std::atomic<uint64_t> fieldsWritten{0};
+        std::atomic<uint64_t> fieldsSkipped{0};
+        Histogram dirtySlots;
+        Histogram flushDurationUs;
+    };
+
+    LatestValueCache(const RedisPool::ptr& redisPool, int intervalMs)
+        : redisPool(redisPool), intervalMs(std::max(intervalMs, 1)), running(false), lastEpoch(0), devices(0) {}
+
+    ~LatestValueCache() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    // 停止前把脏槽位写出
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_all();
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // json 存储：覆盖设备的整条最新值
+    void set(const std::string& uuid, std::string value) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Slot& slot = slotOf(shard, uuid);
+        slot.value = std::move(value);
+        markDirty(shard, uuid, slot);
+    }
+
+    // hash 存储：逐个字段覆盖，值没变的字段不标记
+    void setFields(const std::string& uuid, const SampleText& sample) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Slot& slot = slotOf(shard, uuid);
+        slot.hash = true;
+        bool changed = false;
+        for (size_t i = 0; i < sample.count; ++i) {
+            changed |= setField(slot, sample.name(i), sample.values[i]);
+        }
+        changed |= setField(slot, "timestamp", sample.timestamp);
+        changed |= setField(slot, "captured-at", sample.capturedAt);
+        if (changed) {
+            markDirty(shard, uuid, slot);
+        } else {
+            stats.updates.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 等到调用之后开始的一次刷新完成，即调用前的更新都已交给redis连接；超时返回false
+    bool waitFlushed(int timeoutMs) {
+        uint64_t target = stats.flushes.load() + 2;
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (stats.flushes.load() < target) {
+            if (!running.load() || Clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    size_t size() const { return devices.load(std::memory_order_relaxed); }
+    int getIntervalMs() const { return intervalMs; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Field {
+        std::string value;
+        bool dirty = false;
+        bool written = false;
+    };
+
+    struct Slot {
+        bool hash = false;
+        bool dirty = false;
+        std::string value;
+        std::map<std::string, Field> fields;
+    };
+
+    // 按uuid分片加锁，不同通道的采集线程很少争用同一把锁
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Slot> slots;
+        // 上次刷新后变脏的槽位；unordered_map 的节点地址不会因插入而改变
+        std::vector<std::pair<const std::string*, Slot*>> dirty;
+    };
+
+    enum { kShards = 16 };
+
+    RedisPool::ptr redisPool;
+    int intervalMs;
+    Shard shards[kShards];
+    std::atomic<bool> running;
+    uint64_t lastEpoch;
+    std::atomic<size_t> devices;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread worker;
+    Stats stats;
+
+    Shard& shardOf(const std::string& uuid) {
+        return shards[redisKeyHash(uuid) % kShards];
+    }
+
+    // 值没变且已经写出过的字段不标记，返回是否有变化
+    bool setField(Slot& slot, const std::string& name, const std::string& value) {
+        Field& field = slot.fields[name];
+        if (field.written && !field.dirty && field.value == value) {
+            stats.fieldsSkipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        field.value = value;
+        field.dirty = true;
+        return true;
+    }
+
+    Slot& slotOf(Shard& shard, const std::string& uuid) {
+        auto result = shard.slots.emplace(uuid, Slot());
+        if (result.second) {
+            devices.fetch_add(1, std::memory_order_relaxed);
+        }
+        return result.first->second;
+    }
+
+    void markDirty(Shard& shard, const std::string& uuid, Slot& slot) {
+        stats.updates.fetch_add(1, std::memory_order_relaxed);
+        if (slot.dirty) {
+            stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        slot.dirty = true;
+        shard.dirty.push_back(std::make_pair(&shard.slots.find(uuid)->first, &slot));
+    }
+
+    void run() {
+        auto next = Clock::now();
+        while (running.load()) {
+            next += std::chrono::milliseconds(intervalMs);
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_until(lock, next, [this]{
+                    return !running.load();
+                });
+            }
+            flush();
+            // 刷新耗时超过间隔时不补刷，从当前时刻重新计时
+            if (Clock::now() > next) {
+                next = Clock::now();
+            }
+        }
+        flush();
+    }
+
+    void flush() {
+        auto begin = Clock::now();
+        // 重新连接redis后之前写入的值可能已经丢失，全部重写一次
+        uint64_t epoch = redisPool->connectionEpoch();
+        bool rewrite = epoch != lastEpoch;
+        lastEpoch = epoch;
+
+        std::vector<std::pair<std::string, RedisCommand>> commands;
+        size_t written = 0;
+        for (Shard& shard : shards) {
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (rewrite) {
+                    shard.dirty.clear();
+                    for (auto& kv : shard.slots) {
+                        kv.second.dirty = true;
+                        for (auto& field : kv.second.fields) {
+                            field.second.dirty = true;
+                        }
+                        shard.dirty.push_back(std::make_pair(&kv.first, &kv.second));
+                    }
+                }
+                for (const auto& entry : shard.dirty) {
+                    RedisCommand command = takeCommand(*entry.first, *entry.second);
+                    if (command.size() > 2) {
+                        commands.push_back(std::make_pair(*entry.first, std::move(command)));
+                    }
+                }
+                shard.dirty.clear();
+            }
+            // 发送可能因在途窗口满而阻塞，不持有分片锁
+            for (auto& command : commands) {
+                redisPool->send(command.first, std::move(command.second));
+            }
+            written += commands.size();
+            commands.clear();
+        }
+        stats.slotsWritten.fetch_add(written, std::memory_order_relaxed);
+        stats.dirtySlots.record(written);
+        stats.flushes.fetch_add(1, std::memory_order_relaxed);
+        stats.flushDurationUs.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count()));
+    }
+
+    // 取出槽位当前的写入命令并清除脏标记，调用者持有分片锁
+    RedisCommand takeCommand(const std::string& uuid, Slot& slot) {
+        slot.dirty = false;
+        if (!slot.hash) {
+            return RedisCommand{"SET", uuid, slot.value};
+        }
+        RedisCommand command{"HSET", uuid};
+        for (auto& kv : slot.fields) {
+            if (kv.second.dirty) {
+                command.push_back(kv.first);
+                command.push_back(kv.second.value);
+                kv.second.dirty = false;
+                kv.second.written = true;
+            }
+        }
+        stats.fieldsWritten.fetch_add((command.size() - 2) / 2, std::memory_order_relaxed);
+        return command;
+    }
+};
@@ -12,11 +12,32 @@
 #include <string>
 #include <random>
 #include <unordered_map>
+#include <unordered_set>
 #include <cpp_redis/cpp_redis>
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <cstdlib>
+#include <csignal>
 #include "concurrentqueue.h"
+#include "acquisition_scheduler.h"
+#include "metrics.h"
+#include "modbus_rtu.h"
+#include "serial_reactor.h"
+#include "push_parser.h"
+#include "dimming_rtu.h"
+#include "device_health.h"
+#include "poll_planner.h"
+#include "redis_pool.h"
+#include "latest_value_cache.h"
+#include "reading_cache.h"
+#include "time_index.h"
+#include "file_writer.h"
+#include "sample.h"
+#include "sample_journal.h"
 
 const std::string SERIAL_DATA_TOPIC = "serial/data";
 const std::string COMMAND_TOPIC = "command";
@@ -40,6 +61,14 @@ public:
     std::string location;
     std::map<std::string, std::string> unit;
     std::string manufacturer;
+    // 寄存器类型：holding(功能码03) 或 input(功能码04)
+    std::string registerType = "holding";
+    // 调光灯(dimming-rtu)的通道号、功率以及网络/组/设备地址
+    int channel = 0;
+    int power = 0;
+    std::string panSid;
+    std::string groupSid;
+    std::string deviceSid;
 
     // 构造函数
     Device() {}
@@ -97,6 +126,12 @@ public:
                       parseFields(device["fields"]), device["acquisition-cycle"].asInt(),
                       device["model-type"].asString(), device["location"].asString(), parseUnit(device["unit"]),
                       device["manufacturer"].asString());
+            newDevice.registerType = device.get("register-type", newDevice.registerType).asString();
+            newDevice.channel = device["channel"].asInt();
+            newDevice.power = device["power"].asInt();
+            newDevice.panSid = device["pan-sid"].asString();
+            newDevice.groupSid = device["group-sid"].asString();
+            newDevice.deviceSid = device["device-sid"].asString();
 
             devices[uuid] = newDevice;
         }
@@ -188,92 +223,1184 @@ private:
     DeviceManager::ptr deviceManager;
     DataSimulator::ptr dataSimulator;
 
-    cpp_redis::client redisClient;
+    // 所有通道共用的redis写连接池，按设备uuid选择连接，采集线程不再等待redis应答
+    RedisPool::ptr redisPool;
+
+    // 配置了 write-behind 时最新值先写入共享的写回缓存，由缓存定时只写出变化的设备
+    LatestValueCache::ptr latestValues;
+
+    // 所有设备最近一次的值，查询命令直接读取
+    ReadingCache::ptr readings;
+
+    // uuid.txt 历史文件和 uuid.seg 分列文件，由后台写线程写入
+    FileWriter::ptr files;
+    // 每个设备分列文件的字段表，字段不变时每条采样共用同一份
+    std::unordered_map<std::string, SegmentFields> segmentFields;
+
+    // hash 存储模式下每个设备上次写入的字段值，只发送变化的字段
+    bool hashStorage;
+    std::unordered_map<std::string, std::map<std::string, std::string>> lastValues;
+    uint64_t lastEpoch = 0;
+
+    // 历史stream，已登记到 historyPrefix + "devices" 集合中的stream
+    std::string historyMaxLen;
+    std::unordered_set<std::string> registeredStreams;
+
+    // 时间索引：每个设备的字段顺序（写入过 :fields 的）和写入次数，用于分摊裁剪
+    struct IndexState {
+        std::string fields;
+        uint32_t appends = 0;
+    };
+    std::unordered_map<std::string, IndexState> indexStates;
+
+    // 原子快照：一个tick内采到的最新值先攒起来，commitSnapshot 时用一条 EVAL 整体写入并递增集群版本号
+    std::string snapshotCluster;
+    std::map<std::string, Json::Value> snapshotValues;
+
+    // 预写日志：采样先写入日志再分发，日志记录分发到的序号；快照模式下 commitSnapshot 之后才算分发
+    SampleJournal::ptr journal;
+    uint64_t journalPending = 0;
+    bool printSamples = false;
+
+    // 当前采样的文本形式，所有写出方共用，循环复用
+    SampleText text;
+    std::vector<std::string> mapFields;
+    // 本地时间按秒缓存，同一秒内的采样不再重新格式化
+    time_t timestampSecond = -1;
+    std::string timestampText;
 public:
     using ptr = std::shared_ptr<DataAcquire>;
 
-    DataAcquire() : deviceManager(), dataSimulator(){
+    std::atomic<uint64_t> hashFieldsWritten{0};
+    std::atomic<uint64_t> hashFieldsSkipped{0};
+    std::atomic<uint64_t> snapshots{0};
+    Histogram snapshotDevices;
+
+    explicit DataAcquire(const RedisPool::ptr& redisPool, const LatestValueCache::ptr& latestValues = nullptr,
+                         const ReadingCache::ptr& readings = nullptr, const FileWriter::ptr& files = nullptr)
+        : deviceManager(), dataSimulator(), redisPool(redisPool), latestValues(latestValues), readings(readings),
+          files(files ? files : std::make_shared<FileWriter>()), hashStorage(redisPool->getConfig().storage == "hash"){
+        if (redisPool->getConfig().historyMaxLen > 0) {
+            historyMaxLen = std::to_string(redisPool->getConfig().historyMaxLen);
+        }
         deviceManager = std::make_shared<DeviceManager>();
         dataSimulator = std::make_shared<DataSimulator>();
-
-        redisClient.connect("127.0.0.1", 6379);
     }
 
     void acquire(const std::string& uuid, const std::map<std::string, std::string>& data) {
-        redisClient.set(uuid, dataToJson(data));
-        redisClient.sync_commit();
-
-        Json::Value jsonData;
-        jsonData["uuid"] = uuid; 
-        
+        mapFields.clear();
+        text.values.resize(std::max(text.values.size(), data.size()));
         for (const auto& kv : data) {
-            jsonData[kv.first] = kv.second;
-            
-            std::cout << kv.first << ": " << kv.second << std::endl;
+            text.values[mapFields.size()] = kv.second;
+            mapFields.push_back(kv.first);
+        }
+        text.names = &mapFields;
+        text.count = mapFields.size();
+        auto capturedAt = std::chrono::system_clock::now();
+        acquireValues(uuid, capturedAt);
+        if (files->writesSegments()) {
+            std::vector<std::string> fields;
+            std::vector<double> values;
+            for (const auto& kv : data) {
+                fields.push_back(kv.first);
+                values.push_back(segmentValue(kv.second));
+            }
+            appendSegment(uuid, fields, values.data(), values.size(), capturedAt);
+        }
+    }
+
+    // 定长采样数据直接按设备字段写出，字段名取设备配置，值格式化到复用的缓冲区，不经过 std::map 和 Json::Value
+    void acquire(const Device& device, const Sample& sample) {
+        size_t count = std::min<size_t>(sample.count, device.fields.size());
+        text.values.resize(std::max(text.values.size(), count));
+        for (size_t i = 0; i < count; ++i) {
+            SampleText::format(text.values[i], sample.values[i]);
+        }
+        text.names = &device.fields;
+        text.count = count;
+        // 时间戳取串口I/O完成的时刻，而不是写出的时刻
+        auto capturedAt = std::chrono::system_clock::now() - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::steady_clock::now() - sample.capturedAt);
+        acquireValues(device.uuid, capturedAt);
+        if (files->writesSegments()) {
+            appendSegment(device.uuid, device.fields, sample.values, count, capturedAt);
+        }
+    }
+
+    bool isHashStorage() const {
+        return hashStorage;
+    }
+
+    bool writesBehind() const {
+        return latestValues != nullptr && snapshotCluster.empty();
+    }
+
+    // 之后的最新值按集群原子写入，cluster 为通道uuid；读取方用 MGET cluster:<uuid>:version 设备1 设备2 ... 得到一致的快照
+    void enableSnapshots(const std::string& cluster) {
+        snapshotCluster = cluster;
+    }
+
+    bool snapshotsEnabled() const {
+        return !snapshotCluster.empty();
+    }
+
+    // 每条采样的字段打印到标准输出，调试用
+    void enablePrintSamples() {
+        printSamples = true;
+    }
+
+    // 之后的采样在分发前先写入 journal
+    void enableJournal(const SampleJournal::ptr& journal) {
+        this->journal = journal;
+    }
+
+    const SampleJournal::ptr& getJournal() const {
+        return journal;
+    }
+
+    // 采集线程启动前调用：重新分发上次运行中没有确认的采样（不再写日志），返回条数。
+    // 分列文件只补写比文件中最后一个完整块更新的采样，已经写进块的不重复写
+    size_t recoverJournal() {
+        if (!journal) {
+            return 0;
+        }
+        std::unordered_map<std::string, int64_t> segmentEnd;
+        std::vector<double> values;
+        size_t count = journal->recover([this, &segmentEnd, &values](const SampleJournal::Entry& entry){
+            text.names = &entry.names;
+            text.values = entry.values;
+            text.count = entry.values.size();
+            auto capturedAt = std::chrono::system_clock::time_point(std::chrono::milliseconds(entry.capturedAtMs));
+            stamp(capturedAt);
+            fanOut(entry.uuid);
+            journalPending = entry.seq;
+            if (files->writesSegments()) {
+                auto it = segmentEnd.find(entry.uuid);
+                if (it == segmentEnd.end()) {
+                    it = segmentEnd.emplace(entry.uuid, lastSegmentTime(entry.uuid)).first;
+                }
+                if (entry.capturedAtMs > it->second) {
+                    values.clear();
+                    for (const auto& value : entry.values) {
+                        values.push_back(segmentValue(value));
+                    }
+                    appendSegment(entry.uuid, entry.names, values.data(), values.size(), capturedAt);
+                }
+            }
+        });
+        text.names = nullptr;
+        commitSnapshot();
+        if (journalPending > 0) {
+            journal->markDispatched(journalPending);
+        }
+        return count;
+    }
+
+    // 用启动时从redis加载的值作为 hash 存储变化检测的基准，重启后没有变化的字段不再重写
+    void seedLastValues(const std::vector<std::string>& uuids) {
+        if (!hashStorage || !readings || writesBehind()) {
+            return;
         }
+        lastEpoch = redisPool->connectionEpoch();
+        for (const auto& uuid : uuids) {
+            Json::Value value;
+            if (!readings->get(uuid, value)) {
+                continue;
+            }
+            std::map<std::string, std::string>& last = lastValues[uuid];
+            for (const auto& field : value.getMemberNames()) {
+                last[field] = value[field].asString();
+            }
+        }
+    }
 
-        jsonData["timestamp"] = getCurrentTimestamp();
-        acquireData(uuid, jsonData);
+    // 把本tick攒下的最新值作为一个整体写出，由采集线程在每个tick结束时调用
+    void commitSnapshot() {
+        sendSnapshot();
+        if (journal && journalPending > 0) {
+            journal->markDispatched(journalPending);
+        }
     }
 
-    void acquireData(const std::string& uuid, const Json::Value& jsonData) {
+    // 整个快照按集群uuid选择连接，集群的所有设备key都在同一个redis实例上
+    void sendSnapshot() {
+        if (snapshotValues.empty()) {
+            return;
+        }
+        // KEYS[1] 为版本号，其余为设备；ARGV[1] 为存储方式，json 每个设备一个值，hash 每个设备 字段数 字段 值 ...
+        static const char* script =
+            "local version = redis.call('INCR', KEYS[1]) "
+            "local a = 2 "
+            "for k = 2, #KEYS do "
+            "  if ARGV[1] == 'hash' then "
+            "    local n = tonumber(ARGV[a]) "
+            "    redis.call('HSET', KEYS[k], unpack(ARGV, a + 1, a + 2 * n)) "
+            "    a = a + 2 * n + 1 "
+            "  else "
+            "    redis.call('SET', KEYS[k], ARGV[a]) "
+            "    a = a + 1 "
+            "  end "
+            "end "
+            "return version";
+
+        RedisCommand keys{"cluster:" + snapshotCluster + ":version"};
+        RedisCommand args{hashStorage ? "hash" : "json"};
+        Json::StreamWriterBuilder writer;
+        for (const auto& kv : snapshotValues) {
+            if (hashStorage) {
+                size_t countAt = args.size();
+                args.push_back("");
+                size_t fields = changedFields(kv.first, kv.second, args);
+                if (fields == 0) {
+                    args.resize(countAt);
+                    continue;
+                }
+                args[countAt] = std::to_string(fields);
+            } else {
+                args.push_back(Json::writeString(writer, kv.second));
+            }
+            keys.push_back(kv.first);
+        }
+        snapshotValues.clear();
+        if (keys.size() < 2) {
+            return;
+        }
+
+        RedisCommand command{"EVAL", script, std::to_string(keys.size())};
+        command.insert(command.end(), keys.begin(), keys.end());
+        command.insert(command.end(), args.begin(), args.end());
+        redisPool->send(snapshotCluster, std::move(command));
+        snapshots.fetch_add(1, std::memory_order_relaxed);
+        snapshotDevices.record(keys.size() - 1);
+    }
+
+    // 不是数值的字段记为 NaN
+    static double segmentValue(const std::string& text) {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        return end != text.c_str() && *end == '\0' ? value : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // 设备分列文件中最后一个完整块的最大时间，没有文件时为 int64 最小值
+    int64_t lastSegmentTime(const std::string& uuid) const {
+        int64_t last = std::numeric_limits<int64_t>::min();
+        SegmentReader reader;
+        if (reader.open(files->getSegments()->pathOf(uuid))) {
+            for (const SegmentBlock& block : reader.getBlocks()) {
+                last = std::max(last, block.maxTime);
+            }
+        }
+        return last;
+    }
+
+    void appendSegment(const std::string& uuid, const std::vector<std::string>& fields, const double* values, size_t count,
+                       std::chrono::system_clock::time_point capturedAt) {
+        SegmentFields& schema = segmentFields[uuid];
+        if (!schema || *schema != fields) {
+            schema = std::make_shared<const std::vector<std::string>>(fields);
+        }
+        files->appendSample(uuid, schema, std::chrono::duration_cast<std::chrono::milliseconds>(capturedAt.time_since_epoch()).count(),
+                            values, count);
+    }
+
+    void acquireData(const std::string& uuid, const SampleText& sample) {
+        if (!files->writesText()) {
+            return;
+        }
         // Write the data to a file with the name of the device's UUID
-        std::ofstream dataFile(uuid + ".txt", std::ios::out | std::ios::app);
-        for(const auto& element : jsonData.getMemberNames()){
-            dataFile << element << ": " << jsonData[element].asString() << std::endl;
-            dataFile.flush();
+        std::string lines;
+        for (size_t i = 0; i < sample.count; ++i) {
+            appendLine(lines, sample.name(i), sample.values[i]);
         }
-                
-        dataFile.close();
+        appendLine(lines, "timestamp", sample.timestamp);
+        appendLine(lines, "captured-at", sample.capturedAt);
+        appendLine(lines, "uuid", uuid);
+        files->append(uuid + ".txt", std::move(lines));
     }
 private:
-    std::string getCurrentTimestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto itt = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-        ss << std::put_time(localtime(&itt), "%Y-%m-%dT%H:%M:%SZ");
-        return ss.str();
-    }
-
-    std::string dataToJson(const std::map<std::string, std::string>& data) {
-        // Convert the data map to a JSON string
-        // You might need to modify this part according to your actual data format
-        Json::Value jsonData;
-        for (const auto& kv : data) {
-            jsonData[kv.first] = kv.second;
+    static void appendLine(std::string& lines, const std::string& field, const std::string& value) {
+        lines += field;
+        lines += ": ";
+        lines += value;
+        lines += '\n';
+    }
+
+    // 设置当前采样的采集时间
+    void stamp(std::chrono::system_clock::time_point capturedAt) {
+        auto itt = std::chrono::system_clock::to_time_t(capturedAt);
+        if (itt != timestampSecond) {
+            std::stringstream ss;
+            ss << std::put_time(localtime(&itt), "%Y-%m-%dT%H:%M:%SZ");
+            timestampText = ss.str();
+            timestampSecond = itt;
         }
-        jsonData["timestamp"] = getCurrentTimestamp();
-        Json::StreamWriterBuilder writer;
-        return Json::writeString(writer, jsonData);
+        text.timestamp = timestampText;
+        text.capturedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(capturedAt.time_since_epoch()).count();
+        text.capturedAt = std::to_string(text.capturedAtMs);
+    }
+
+    // HSET uuid field value ...，只带上和上次写入不同的字段；重新连接redis后全部重写一次
+    // 重新连接redis后，之前记录的写入状态不再可信
+    void checkConnectionEpoch() {
+        uint64_t epoch = redisPool->connectionEpoch();
+        if (epoch != lastEpoch) {
+            lastValues.clear();
+            registeredStreams.clear();
+            indexStates.clear();
+            lastEpoch = epoch;
+        }
+    }
+
+    void writeChangedFields(const std::string& uuid, const SampleText& sample) {
+        RedisCommand command{"HSET", uuid};
+        std::map<std::string, std::string>& last = lastValues[uuid];
+        size_t fields = 0;
+        for (size_t i = 0; i < sample.count; ++i) {
+            fields += changedField(last, sample.name(i), sample.values[i], command);
+        }
+        fields += changedField(last, "timestamp", sample.timestamp, command);
+        fields += changedField(last, "captured-at", sample.capturedAt, command);
+        if (fields > 0) {
+            redisPool->send(uuid, std::move(command));
+        }
+    }
+
+    // 把和上次写入不同的 字段 值 追加到 out，返回字段数
+    size_t changedFields(const std::string& uuid, const Json::Value& jsonData, RedisCommand& out) {
+        std::map<std::string, std::string>& last = lastValues[uuid];
+        size_t fields = 0;
+        for (const auto& field : jsonData.getMemberNames()) {
+            fields += changedField(last, field, jsonData[field].asString(), out);
+        }
+        return fields;
+    }
+
+    // 值和上次写入的不同时追加 字段 值 并返回1
+    size_t changedField(std::map<std::string, std::string>& last, const std::string& field, const std::string& value,
+                        RedisCommand& out) {
+        auto it = last.find(field);
+        if (it != last.end() && it->second == value) {
+            hashFieldsSkipped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        if (it == last.end()) {
+            last.emplace(field, value);
+        } else {
+            it->second = value;
+        }
+        out.push_back(field);
+        out.push_back(value);
+        hashFieldsWritten.fetch_add(1, std::memory_order_relaxed);
+        return 1;
+    }
+
+    // XADD history:uuid MAXLEN ~ N * 字段 值 ...
+    // 每个设备一个stream，stream名登记在所在redis实例的 history:devices 集合中，下游服务可以据此创建消费组并用 XREADGROUP 读取
+    void appendHistory(const std::string& uuid, const SampleText& sample) {
+        const std::string& prefix = redisPool->getConfig().historyPrefix;
+        std::string stream = prefix + uuid;
+        if (registeredStreams.insert(uuid).second) {
+            redisPool->send(uuid, {"SADD", prefix + "devices", stream});
+        }
+
+        RedisCommand command{"XADD", stream, "MAXLEN", "~", historyMaxLen, "*"};
+        for (size_t i = 0; i < sample.count; ++i) {
+            command.push_back(sample.name(i));
+            command.push_back(sample.values[i]);
+        }
+        command.push_back("timestamp");
+        command.push_back(sample.timestamp);
+        command.push_back("captured-at");
+        command.push_back(sample.capturedAt);
+        redisPool->send(uuid, std::move(command));
+    }
+
+    // ZADD ts:uuid 采集时间 "时间|值1|值2..."，字段顺序变化时重写 ts:uuid:fields
+    // 每 indexTrimEvery 条用一次 ZREMRANGEBYSCORE 删除保留期之前的数据，和写入一起pipeline发出
+    void appendIndex(const std::string& uuid, const SampleText& sample) {
+        const RedisConfig& config = redisPool->getConfig();
+        std::string key = config.indexPrefix + uuid;
+        int64_t capturedAtMs = sample.capturedAtMs;
+
+        IndexState& state = indexStates[uuid];
+        std::string encodedFields = encodeIndexFields(*sample.names, sample.count);
+        if (encodedFields != state.fields) {
+            redisPool->send(uuid, {"SET", key + ":fields", encodedFields});
+            state.fields = encodedFields;
+        }
+        redisPool->send(uuid, {"ZADD", key, sample.capturedAt, encodeIndexMember(capturedAtMs, sample.values, sample.count)});
+        if (++state.appends % std::max<uint32_t>(config.indexTrimEvery, 1) == 0) {
+            redisPool->send(uuid, {"ZREMRANGEBYSCORE", key, "-inf", "(" + std::to_string(capturedAtMs - config.indexRetentionMs)});
+        }
+    }
+
+    // 当前采样（text）先写入 journal，再分发
+    void acquireValues(const std::string& uuid, std::chrono::system_clock::time_point capturedAt) {
+        stamp(capturedAt);
+        if (!journal) {
+            fanOut(uuid);
+            return;
+        }
+        uint64_t seq = journal->append(uuid, text.capturedAtMs, *text.names, text.values, text.count);
+        fanOut(uuid);
+        if (seq == 0) {
+            return;
+        }
+        if (snapshotCluster.empty()) {
+            journal->markDispatched(seq);
+        } else {
+            journalPending = seq;
+        }
+    }
+
+    // 用当前采样更新最新值缓存并写入redis和txt文件；只有需要JSON的地方（查询缓存、快照、json存储）才生成JSON
+    void fanOut(const std::string& uuid) {
+        const SampleText& sample = text;
+        if (readings) {
+            readings->update(uuid, sample);
+        }
+        checkConnectionEpoch();
+        if (!snapshotCluster.empty()) {
+            // 同一tick内同一设备多次采样时合并，后到的字段覆盖先到的
+            Json::Value& pending = snapshotValues[uuid];
+            for (size_t i = 0; i < sample.count; ++i) {
+                pending[sample.name(i)] = sample.values[i];
+            }
+            pending["timestamp"] = sample.timestamp;
+            pending["captured-at"] = Json::Int64(sample.capturedAtMs);
+        } else if (latestValues && hashStorage) {
+            latestValues->setFields(uuid, sample);
+        } else if (latestValues) {
+            std::string json;
+            appendSampleJson(json, sample);
+            latestValues->set(uuid, std::move(json));
+        } else if (hashStorage) {
+            writeChangedFields(uuid, sample);
+        } else {
+            std::string json;
+            appendSampleJson(json, sample);
+            redisPool->send(uuid, {"SET", uuid, std::move(json)});
+        }
+        if (!historyMaxLen.empty()) {
+            appendHistory(uuid, sample);
+        }
+        if (redisPool->getConfig().indexRetentionMs > 0) {
+            appendIndex(uuid, sample);
+        }
+
+        if (printSamples) {
+            for (size_t i = 0; i < sample.count; ++i) {
+                std::cout << sample.name(i) << ": " << sample.values[i] << std::endl;
+            }
+        }
+
+        acquireData(uuid, sample);
     }
 };
 
 
-class SerialManager{
+// 串口通道配置，对应 serial_config.json 中 devices 的一项
+struct SerialChannelConfig {
+    std::string uuid;
+    std::string key;
+    std::string alias;
+    std::string modelType;
+    std::string fetchType;
+    SerialPortConfig dev;
+    // 轮询规划用的从站响应时间估计(ms)，以及是否允许跨过空洞寄存器合并请求
+    int turnaroundMs = 2;
+    bool mergeRegisterGaps = false;
+    // 按墙上时间对齐采集时刻，同一时刻的轮询在 staggerWindowMs 内错开
+    bool alignToWallClock = false;
+    int staggerWindowMs = 200;
+    // 每个tick采到的最新值作为一个整体原子写入redis，并递增集群版本号
+    bool atomicSnapshot = false;
+    // 采样打印到标准输出（顶层的 print-samples）
+    bool printSamples = false;
+    // dimming-rtu 的帧格式是占位实现（见 dimming_rtu.h），为 "placeholder" 时才启用调光驱动
+    std::string dimmingFrame;
+};
+
+// 一个串口通道（一条物理总线）的采集工作线程
+// 每个通道有独立的设备列表、采集计划和任务队列，某条总线变慢或超时不会拖慢其他通道
+class SerialChannel {
 private:
-    std::vector<std::string> serialUUIDs;
+    SerialChannelConfig config;
     DeviceManager deviceManager;
     DataSimulator dataSimulator;
     DataAcquire::ptr dataAcquire;
 
+    // 串口注册在所有通道共用的reactor上；modbus-rtu 通道串口打不开时退回模拟数据
+    SerialReactor::ptr reactor;
+    int portId = -1;
+    std::unique_ptr<ReactorTransport> transport;
+    std::unique_ptr<ModbusRtuMaster> modbus;
+    std::vector<uint16_t> registers;
+
+    // fetch-type 为 push 的通道：reactor线程解析上报帧，采集线程按从站地址对应到设备
+    std::unique_ptr<PushFrameParser> pushParser;
+    moodycamel::ConcurrentQueue<PushFrame> pushFrames;
+    std::vector<int32_t> deviceBySlave;
+    std::atomic<uint64_t> unknownSlaves{0};
+
+    // dimming-rtu 通道：命令流水线写出，应答由reactor线程异步匹配后交回采集线程
+    struct DimmingAck {
+        std::string uuid;
+        uint8_t opcode;
+        bool ok;
+        uint8_t level;
+        std::chrono::steady_clock::time_point capturedAt;
+    };
+    std::unique_ptr<DimmingDriver> dimming;
+    moodycamel::ConcurrentQueue<DimmingAck> dimmingAcks;
+
+    // 采集调度：scheduledDevices[i] 对应 scheduler 中的第i个定时器
+    std::mutex scheduleMutex;
+    std::vector<Device> scheduledDevices;
+    // uuid 到 scheduledDevices 下标
+    std::unordered_map<std::string, uint32_t> scheduledIndex;
+    AcquisitionScheduler::ptr scheduler;
+    DeviceHealth::ptr health;
+    PollPlan plan;
+    uint16_t registerGap = 0;
+    // 对齐模式下每个设备的周期和周期内相位，定期按墙上时间重新校正
+    std::vector<int> scheduleCycles;
+    std::vector<int> scheduleStagger;
+    std::chrono::steady_clock::time_point nextRealign;
+
+    // 投递到本通道线程执行的任务
+    moodycamel::ConcurrentQueue<std::function<void()>> tasks;
+    std::atomic<bool> running{false};
+    std::thread worker;
+
+    // 通道统计
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<uint64_t> samples{0};
+    Histogram pollLatency;
+
+    // 实际总线占用：modbus事务累计耗时，stats按两次查询之间的增量计算占用率
+    std::atomic<uint64_t> busBusyUs{0};
+    uint64_t lastBusBusyUs = 0;
+    std::chrono::steady_clock::time_point lastStatsTime;
+
+    enum { kPushDrainIntervalMs = 10, kMaxProbesPerTick = 1, kTickMs = 10, kRealignIntervalMs = 60000 };
+
 public:
-    using ptr =  std::shared_ptr<SerialManager>;
-    SerialManager(){
-        loadSerialConfig("serial_config.json");
+    using ptr = std::shared_ptr<SerialChannel>;
+
+    SerialChannel(const SerialChannelConfig& config, const SerialReactor::ptr& reactor, const RedisPool::ptr& redisPool,
+                  const LatestValueCache::ptr& latestValues, const ReadingCache::ptr& readings, const FileWriter::ptr& files)
+        : config(config), reactor(reactor) {
+        dataAcquire = std::make_shared<DataAcquire>(redisPool, latestValues, readings, files);
+        if (config.atomicSnapshot) {
+            dataAcquire->enableSnapshots(config.uuid);
+        }
+        if (config.printSamples) {
+            dataAcquire->enablePrintSamples();
+        }
+    }
 
-        loadDevicesFromSerials();
+    ~SerialChannel() {
+        stop();
+    }
 
+    const SerialChannelConfig& getConfig() const {
+        return config;
+    }
 
-        dataAcquire = std::make_shared<DataAcquire>();
+    std::vector<std::string> deviceUuids() {
+        std::vector<std::string> uuids;
+        for (const auto& uuid_device : deviceManager.getDevices()) {
+            uuids.push_back(uuid_device.first);
+        }
+        return uuids;
     }
 
-    // 加载设备配置文件
-    bool loadSingleDeviceFromFile(const std::string& filename) {
-        return deviceManager.loadDeviceFromFile(filename);
+    // 采集线程启动前调用
+    void seedBaseline() {
+        dataAcquire->seedLastValues(deviceUuids());
+    }
+
+    void enableJournal(const SampleJournal::ptr& journal) {
+        dataAcquire->enableJournal(journal);
+    }
+
+    // 采集线程启动前调用，回放上次运行中没有确认的采样
+    void recoverJournal() {
+        const SampleJournal::ptr& journal = dataAcquire->getJournal();
+        if (!journal) {
+            return;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        size_t count = dataAcquire->recoverJournal();
+        std::cout << "Journal " << journal->getPath() << ": replayed " << count << " samples in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count()
+                  << " ms" << std::endl;
+    }
+
+    // 加载通道下的设备配置文件
+    bool loadDevices() {
+        return deviceManager.loadDeviceFromFile(config.uuid + ".json");
+    }
+
+    // 打开串口并注册到reactor，需在reactor启动之前调用
+    bool openPort() {
+        if (config.dev.instance.empty()) {
+            return false;
+        }
+        if (config.modelType == "dimming-rtu" && config.fetchType != "push" && config.dimmingFrame != "placeholder") {
+            std::cerr << "Channel " << config.uuid << ": dimming-rtu frame format is a placeholder, set \"dimming-frame\":\"placeholder\""
+                      << " to drive " << config.dev.instance << " with it; using simulated data" << std::endl;
+            return false;
+        }
+        portId = reactor->addPort(config.dev);
+        if (portId < 0) {
+            std::cerr << "Serial port " << config.dev.instance << " unavailable, using simulated data" << std::endl;
+            return false;
+        }
+        transport.reset(new ReactorTransport(*reactor, portId));
+        if (config.fetchType == "push") {
+            pushParser.reset(new PushFrameParser([this](const PushFrame& frame){
+                pushFrames.enqueue(frame);
+            }));
+            reactor->setStreamReader(portId, pushParser.get());
+        } else if (config.modelType == "modbus-rtu") {
+            modbus.reset(new ModbusRtuMaster(*transport, config.dev));
+        } else if (config.modelType == "dimming-rtu") {
+            dimming.reset(new DimmingDriver(*reactor, portId, config.dev,
+                [this](const DimmingDriver::Command& command, bool ok, uint8_t level){
+                    dimmingAcks.enqueue(DimmingAck{command.uuid, command.opcode, ok, level, std::chrono::steady_clock::now()});
+                }));
+            reactor->setStreamReader(portId, dimming.get());
+        }
+        return true;
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        startTime = std::chrono::steady_clock::now();
+        lastStatsTime = startTime;
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    // 停止采集线程并等待它退出：当前tick处理完（正在进行的串口事务最多等到应答超时）并提交快照后返回，
+    // 之后不会再有数据交给 DataAcquire
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // 在通道线程中重新加载设备配置并重建采集计划
+    void reload() {
+        post([this](){
+            //reload
+            loadDevices();
+            rebuildSchedule();
+        });
+    }
+
+    void post(const std::function<void()>& task) {
+        tasks.enqueue(task);
+    }
+
+    // 调光控制：按 uuid / uuids / location 选中本通道的灯，设置 percentage(0~100)
+    void control(const Json::Value& request) {
+        if (!dimming) {
+            return;
+        }
+        post([this, request](){
+            int level = std::max(0, std::min(100, request["percentage"].asInt()));
+            std::vector<DimmingDriver::Command> commands;
+            for (size_t i = 0; i < scheduledDevices.size(); ++i) {
+                if (matchesControl(scheduledDevices[i], request)) {
+                    DimmingDriver::Command command;
+                    if (makeDimmingCommand(static_cast<uint32_t>(i), DIMMING_SET_LEVEL, command)) {
+                        command.level = static_cast<uint8_t>(level);
+                        commands.push_back(command);
+                    }
+                }
+            }
+            dimming->submit(commands);
+        });
+    }
+
+    Json::Value collectStats() {
+        Json::Value stats;
+        double uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        uint64_t total = samples.load(std::memory_order_relaxed);
+        stats["instance"] = config.dev.instance;
+        stats["model-type"] = config.modelType;
+        stats["samples"] = Json::UInt64(total);
+        stats["samples-per-sec"] = uptime > 0 ? total / uptime : 0.0;
+        stats["poll-latency-us"] = pollLatency.toJson();
+        if (dataAcquire->isHashStorage() && !dataAcquire->writesBehind()) {
+            stats["redis-hash"]["fields-written"] = Json::UInt64(dataAcquire->hashFieldsWritten.load());
+            stats["redis-hash"]["fields-skipped"] = Json::UInt64(dataAcquire->hashFieldsSkipped.load());
+        }
+        if (dataAcquire->snapshotsEnabled()) {
+            stats["snapshots"]["commits"] = Json::UInt64(dataAcquire->snapshots.load());
+            stats["snapshots"]["devices"] = dataAcquire->snapshotDevices.toJson();
+        }
+        if (const SampleJournal::ptr& journal = dataAcquire->getJournal()) {
+            const SampleJournal::Stats& wal = journal->getStats();
+            stats["journal"]["appended"] = Json::UInt64(wal.appended.load());
+            stats["journal"]["last-seq"] = Json::UInt64(wal.lastSeq.load());
+            stats["journal"]["dispatched-seq"] = Json::UInt64(journal->dispatchedSeq());
+            stats["journal"]["acked-seq"] = Json::UInt64(wal.ackedSeq.load());
+            stats["journal"]["used-bytes"] = Json::UInt64(wal.usedBytes.load());
+            stats["journal"]["capacity"] = Json::UInt64(journal->getCapacity());
+            stats["journal"]["overruns"] = Json::UInt64(wal.overruns.load());
+            stats["journal"]["recovered"] = Json::UInt64(wal.recovered.load());
+            stats["journal"]["syncs"] = Json::UInt64(wal.syncs.load());
+            stats["journal"]["sync-us"] = wal.syncUs.toJson();
+        }
+        if (portId >= 0) {
+            const SerialReactor::PortStats& serial = reactor->statsOf(portId);
+            stats["serial"]["transactions"] = Json::UInt64(serial.transactions.load());
+            stats["serial"]["timeouts"] = Json::UInt64(serial.timeouts.load());
+            stats["serial"]["bytes-written"] = Json::UInt64(serial.bytesWritten.load());
+            stats["serial"]["bytes-read"] = Json::UInt64(serial.bytesRead.load());
+            stats["serial"]["unsolicited-bytes"] = Json::UInt64(serial.unsolicitedBytes.load());
+            stats["serial"]["failures"] = Json::UInt64(serial.failures.load());
+            stats["serial"]["reopens"] = Json::UInt64(serial.reopens.load());
+        }
+        if (pushParser) {
+            const PushFrameParser::Stats& push = pushParser->getStats();
+            stats["push"]["bytes"] = Json::UInt64(push.bytes.load());
+            stats["push"]["frames"] = Json::UInt64(push.frames.load());
+            stats["push"]["exceptions"] = Json::UInt64(push.exceptions.load());
+            stats["push"]["crc-errors"] = Json::UInt64(push.crcErrors.load());
+            stats["push"]["resyncs"] = Json::UInt64(push.resyncs.load());
+            stats["push"]["overflows"] = Json::UInt64(push.overflows.load());
+            stats["push"]["unknown-slaves"] = Json::UInt64(unknownSlaves.load());
+        }
+        if (dimming) {
+            const DimmingDriver::Stats& light = dimming->getStats();
+            stats["dimming"]["sent"] = Json::UInt64(light.sent.load());
+            stats["dimming"]["acked"] = Json::UInt64(light.acked.load());
+            stats["dimming"]["retries"] = Json::UInt64(light.retries.load());
+            stats["dimming"]["failures"] = Json::UInt64(light.failures.load());
+            stats["dimming"]["crc-errors"] = Json::UInt64(light.crcErrors.load());
+            stats["dimming"]["stray-acks"] = Json::UInt64(light.strayAcks.load());
+            stats["dimming"]["pending"] = Json::UInt64(dimming->pending());
+            stats["dimming"]["ack-latency-us"] = light.ackLatencyUs.toJson();
+        }
+        if (modbus) {
+            const ModbusRtuMaster::Stats& bus = modbus->getStats();
+            stats["modbus"]["transactions"] = Json::UInt64(bus.transactions.load());
+            stats["modbus"]["timeouts"] = Json::UInt64(bus.timeouts.load());
+            stats["modbus"]["crc-errors"] = Json::UInt64(bus.crcErrors.load());
+            stats["modbus"]["bad-frames"] = Json::UInt64(bus.badFrames.load());
+            stats["modbus"]["exceptions"] = Json::UInt64(bus.exceptions.load());
+        }
+        stats["devices"] = Json::Value(Json::objectValue);
+
+        // 每个设备的触发次数、迟到次数、跳过周期数以及延迟
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        if (!scheduler) {
+            return stats;
+        }
+        uint64_t open = 0, halfOpen = 0, busTimeLostUs = 0;
+        for (size_t i = 0; i < scheduledDevices.size(); ++i) {
+            AcquisitionScheduler::SlotStats slot = scheduler->statsOf(i);
+            Json::Value item;
+            item["acquisition-cycle"] = scheduler->cycleOf(i);
+            item["fired"] = Json::UInt64(slot.fired);
+            item["late"] = Json::UInt64(slot.late);
+            item["skipped"] = Json::UInt64(slot.skipped);
+            item["last-lateness-ms"] = Json::Int64(slot.lastLatenessMs);
+            item["max-lateness-ms"] = Json::Int64(slot.maxLatenessMs);
+            if (config.alignToWallClock) {
+                item["realigned"] = Json::UInt64(slot.realigned);
+            }
+            if (modbus) {
+                item["poll-cost-us"] = Json::Int64(i < plan.costUs.size() ? plan.costUs[i] : 0);
+                DeviceHealth::DeviceStats device = health->statsOf(i);
+                item["breaker"]["state"] = DeviceHealth::stateName(device.state);
+                item["breaker"]["consecutive-timeouts"] = device.consecutiveFailures;
+                item["breaker"]["opens"] = Json::UInt64(device.opens);
+                item["breaker"]["probes"] = Json::UInt64(device.probes);
+                item["breaker"]["backoff-ms"] = device.backoffMs;
+                item["breaker"]["bus-time-lost-ms"] = device.busTimeLostUs / 1000.0;
+                open += device.state == DeviceHealth::Open ? 1 : 0;
+                halfOpen += device.state == DeviceHealth::HalfOpen ? 1 : 0;
+                busTimeLostUs += device.busTimeLostUs;
+            }
+            stats["devices"][scheduledDevices[i].uuid] = item;
+        }
+        if (modbus) {
+            auto now = std::chrono::steady_clock::now();
+            uint64_t busy = busBusyUs.load(std::memory_order_relaxed);
+            double windowUs = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(now - lastStatsTime).count());
+            stats["planner"]["projected-utilization"] = plan.projectedUtilization;
+            stats["planner"]["achieved-utilization"] = windowUs > 0 ? (busy - lastBusBusyUs) / windowUs : 0.0;
+            stats["planner"]["oversubscribed"] = plan.oversubscribed();
+            stats["planner"]["projected-requests-per-sec"] = plan.requestsPerSecond;
+            stats["planner"]["register-gap"] = registerGap;
+            lastBusBusyUs = busy;
+            lastStatsTime = now;
+
+            stats["breakers"]["open"] = Json::UInt64(open);
+            stats["breakers"]["half-open"] = Json::UInt64(halfOpen);
+            stats["breakers"]["bus-time-lost-ms"] = busTimeLostUs / 1000.0;
+        }
+        return stats;
+    }
+
+private:
+    // 模拟并发送设备数据
+    void run() {
+        rebuildSchedule();
+
+        std::vector<uint32_t> due;
+        while (running.load()) {
+            std::function<void()> task;
+            while (tasks.try_dequeue(task)) {
+                task();
+            }
+
+            if (pushParser) {
+                drainPushFrames();
+                dataAcquire->commitSnapshot();
+                std::this_thread::sleep_for(std::chrono::milliseconds(kPushDrainIntervalMs));
+                continue;
+            }
+
+            // 等待时间轮上到期的设备，每个设备按自己的采集周期独立触发
+            scheduler->waitTick(due);
+            realignSchedule();
+            if (modbus) {
+                pollModbus(due);
+                dataAcquire->commitSnapshot();
+                continue;
+            }
+            if (dimming) {
+                pollDimming(due);
+                dataAcquire->commitSnapshot();
+                continue;
+            }
+            for (uint32_t index : due) {
+                const Device& device = scheduledDevices[index];
+                auto begin = std::chrono::steady_clock::now();
+
+                std::map<std::string, std::string> simulatedData = dataSimulator.simulateData(device);
+                std::cout << device.uuid << std::endl;
+
+                dataAcquire->acquire(device.uuid, simulatedData);
+                std::cout << "acqu: " << device.acquisitionCycle << std::endl;
+
+                samples.fetch_add(1, std::memory_order_relaxed);
+                pollLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+            }
+            dataAcquire->commitSnapshot();
+        }
+        dataAcquire->commitSnapshot();
+    }
+
+    // 轮询本tick到期的modbus设备：同一从站相邻或重叠的寄存器合并为一次请求，应答再按设备拆分
+    // 断路器断开的设备跳过；半开的设备在正常请求之后单独探测，每tick最多 kMaxProbesPerTick 个
+    void pollModbus(const std::vector<uint32_t>& due) {
+        auto now = std::chrono::steady_clock::now();
+        std::vector<ModbusReadSpec> specs;
+        std::vector<ModbusReadSpec> probes;
+        for (uint32_t index : due) {
+            ModbusReadSpec spec;
+            if (!makeReadSpec(index, spec)) {
+                continue;
+            }
+            switch (health->check(index, now)) {
+                case DeviceHealth::Poll:
+                    specs.push_back(spec);
+                    break;
+                case DeviceHealth::Probe:
+                    if (probes.size() < kMaxProbesPerTick) {
+                        probes.push_back(spec);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (const auto& request : planModbusReads(specs, 125, registerGap)) {
+            readModbus(request);
+        }
+        for (const auto& probe : probes) {
+            readModbus(planModbusReads(std::vector<ModbusReadSpec>(1, probe)).front());
+        }
+    }
+
+    // 每次事务的结果都计入请求中每个设备的断路器：超时、CRC或帧错误算失败，占用的总线时间平均分摊；
+    // 异常应答说明从站在线，和正常应答一样算成功（半开的探测因此一定会有结论），只是没有数据
+    void readModbus(const ModbusReadRequest& request) {
+        auto begin = std::chrono::steady_clock::now();
+        ModbusStatus status = modbus->read(request, registers);
+        auto end = std::chrono::steady_clock::now();
+        int64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+        pollLatency.record(elapsedUs);
+        busBusyUs.fetch_add(static_cast<uint64_t>(elapsedUs), std::memory_order_relaxed);
+
+        bool responded = status == ModbusStatus::Ok || status == ModbusStatus::Exception;
+        for (const auto& member : request.members) {
+            if (responded) {
+                health->onSuccess(member.owner);
+            } else {
+                health->onFailure(member.owner, end, elapsedUs / static_cast<int64_t>(request.members.size()));
+            }
+        }
+        if (status != ModbusStatus::Ok) {
+            std::cerr << "Modbus read from slave " << static_cast<int>(request.slave) << " failed" << std::endl;
+            return;
+        }
+
+        for (const auto& member : request.members) {
+            acquireRegisters(member.owner, &registers[member.offset], member.count, modbus->lastCompletedAt());
+        }
+    }
+
+    bool makeReadSpec(uint32_t index, ModbusReadSpec& spec) const {
+        const Device& device = scheduledDevices[index];
+        if (device.address < 1 || device.address > 247 || device.fields.empty()) {
+            return false;
+        }
+        spec.slave = static_cast<uint8_t>(device.address);
+        spec.function = device.registerType == "input" ? MODBUS_READ_INPUT_REGISTERS : MODBUS_READ_HOLDING_REGISTERS;
+        spec.start = static_cast<uint16_t>(device.startOffset);
+        spec.count = static_cast<uint16_t>(device.fields.size());
+        spec.owner = index;
+        return true;
     }
 
+    // 到期的灯发送查询命令，应答和控制命令的应答一起在这里处理
+    void pollDimming(const std::vector<uint32_t>& due) {
+        std::vector<DimmingDriver::Command> commands;
+        for (uint32_t index : due) {
+            DimmingDriver::Command command;
+            if (makeDimmingCommand(index, DIMMING_QUERY_LEVEL, command)) {
+                commands.push_back(command);
+            }
+        }
+        if (!commands.empty()) {
+            dimming->submit(commands);
+        }
+        dimming->expire(std::chrono::steady_clock::now());
+
+        DimmingAck acks[64];
+        size_t n;
+        while ((n = dimmingAcks.try_dequeue_bulk(acks, 64)) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                // 命令发出后设备列表可能已经重新加载，按 uuid 找到当前的设备，已删除的设备丢弃应答
+                auto it = scheduledIndex.find(acks[i].uuid);
+                if (it == scheduledIndex.end()) {
+                    continue;
+                }
+                const Device& device = scheduledDevices[it->second];
+                if (!acks[i].ok) {
+                    std::cerr << "Dimming command to " << device.uuid << " failed" << std::endl;
+                    continue;
+                }
+                Sample sample;
+                sample.device = it->second;
+                sample.count = device.fields.empty() ? 0 : 1;
+                sample.values[0] = acks[i].level;
+                sample.capturedAt = acks[i].capturedAt;
+                dataAcquire->acquire(device, sample);
+                samples.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool makeDimmingCommand(uint32_t index, uint8_t opcode, DimmingDriver::Command& command) {
+        const Device& device = scheduledDevices[index];
+        if (!parseDimmingSid(device.deviceSid, command.sid)) {
+            std::cerr << "Invalid device-sid for " << device.uuid << ": " << device.deviceSid << std::endl;
+            return false;
+        }
+        command.uuid = device.uuid;
+        command.channel = static_cast<uint8_t>(device.channel);
+        command.opcode = opcode;
+        return true;
+    }
+
+    static bool matchesControl(const Device& device, const Json::Value& request) {
+        if (request.isMember("uuid") && request["uuid"].asString() == device.uuid) {
+            return true;
+        }
+        for (const auto& uuid : request["uuids"]) {
+            if (uuid.asString() == device.uuid) {
+                return true;
+            }
+        }
+        return request.isMember("location") && request["location"].asString() == device.location;
+    }
+
+    // 把上报帧按从站地址对应到设备
+    void drainPushFrames() {
+        PushFrame frames[32];
+        size_t n;
+        while ((n = pushFrames.try_dequeue_bulk(frames, 32)) > 0) {
+            for (size_t i = 0; i < n; ++i) {
+                int32_t index = deviceBySlave[frames[i].slave];
+                if (index < 0) {
+                    unknownSlaves.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                acquireRegisters(static_cast<uint32_t>(index), frames[i].registers, frames[i].count, frames[i].capturedAt);
+            }
+        }
+    }
+
+    // 每个寄存器对应设备的一个字段，按有符号16位解析
+    void acquireRegisters(uint32_t index, const uint16_t* values, size_t count,
+                          std::chrono::steady_clock::time_point capturedAt) {
+        const Device& device = scheduledDevices[index];
+        Sample sample;
+        sample.device = index;
+        sample.capturedAt = capturedAt;
+        sample.count = static_cast<uint32_t>(std::min(std::min(device.fields.size(), count),
+                                                      static_cast<size_t>(Sample::kMaxValues)));
+        for (uint32_t i = 0; i < sample.count; ++i) {
+            sample.values[i] = static_cast<int16_t>(values[i]);
+        }
+        dataAcquire->acquire(device, sample);
+        samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 占位协议按 device-sid + channel 寻址，共用地址的灯在真实总线上会同时应答
+    static void warnSharedDimmingAddresses(const std::vector<Device>& devices) {
+        std::map<std::pair<std::string, int>, std::string> owners;
+        for (const auto& device : devices) {
+            auto inserted = owners.emplace(std::make_pair(device.deviceSid, device.channel), device.uuid);
+            if (!inserted.second) {
+                std::cerr << "Dimming devices " << inserted.first->second << " and " << device.uuid << " share device-sid "
+                          << device.deviceSid << " channel " << device.channel << std::endl;
+            }
+        }
+    }
+
+    // 根据当前设备列表重建采集计划
+    void rebuildSchedule() {
+        std::vector<Device> devices;
+        std::vector<int> cycles;
+        deviceBySlave.assign(256, -1);
+        for (const auto& uuid_device : deviceManager.getDevices()) {
+            const Device& device = uuid_device.second;
+            if (device.address > 0 && device.address < 256) {
+                deviceBySlave[device.address] = static_cast<int32_t>(devices.size());
+            }
+            devices.push_back(device);
+            cycles.push_back(device.acquisitionCycle);
+        }
+
+        std::unordered_map<std::string, uint32_t> index;
+        for (size_t i = 0; i < devices.size(); ++i) {
+            index[devices[i].uuid] = static_cast<uint32_t>(i);
+        }
+        if (dimming) {
+            warnSharedDimmingAddresses(devices);
+        }
+        // 断路器状态按 uuid 沿用
+        DeviceHealth::ptr nextHealth = std::make_shared<DeviceHealth>(devices.size());
+        if (health) {
+            for (size_t i = 0; i < devices.size(); ++i) {
+                auto it = scheduledIndex.find(devices[i].uuid);
+                if (it != scheduledIndex.end()) {
+                    nextHealth->carryOver(i, *health, it->second);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(scheduleMutex);
+        scheduledDevices.swap(devices);
+        scheduledIndex.swap(index);
+        health = nextHealth;
+        nextRealign = std::chrono::steady_clock::now() + std::chrono::milliseconds(kRealignIntervalMs);
+        scheduleCycles = cycles;
+        if (!modbus) {
+            // 没有总线规划，同一周期的设备在错开窗口内均匀排开
+            std::vector<int> offsets;
+            scheduleStagger = evenStagger(cycles);
+            if (config.alignToWallClock) {
+                offsets = alignedOffsets(cycles, scheduleStagger, config.staggerWindowMs);
+            }
+            scheduler = std::make_shared<AcquisitionScheduler>(cycles, kTickMs, offsets);
+            return;
+        }
+
+        // modbus 通道按总线时间规划：预先计算占用率，并错开各从站的轮询相位
+        int64_t turnaroundUs = static_cast<int64_t>(config.turnaroundMs) * 1000;
+        registerGap = config.mergeRegisterGaps ? modbusBreakEvenGap(config.dev, turnaroundUs) : 0;
+        std::vector<ModbusReadSpec> specs;
+        for (size_t i = 0; i < scheduledDevices.size(); ++i) {
+            ModbusReadSpec spec;
+            if (makeReadSpec(static_cast<uint32_t>(i), spec)) {
+                specs.push_back(spec);
+            }
+        }
+        plan = planPolls(config.dev, specs, cycles, turnaroundUs, registerGap, kTickMs);
+        if (plan.oversubscribed()) {
+            std::cerr << "Bus " << config.dev.instance << " is oversubscribed: projected utilization "
+                      << plan.projectedUtilization << std::endl;
+        }
+        // 对齐模式下规划出的相位按比例压缩到错开窗口内
+        std::vector<int> offsets = plan.offsetsMs;
+        scheduleStagger = plan.offsetsMs;
+        if (config.alignToWallClock) {
+            offsets = alignedOffsets(cycles, plan.offsetsMs, config.staggerWindowMs);
+        }
+        scheduler = std::make_shared<AcquisitionScheduler>(cycles, kTickMs, offsets);
+    }
+
+    // 对齐模式下每 kRealignIntervalMs 按当前墙上时间重新计算相位，校正调度和墙上时间之间的偏离
+    void realignSchedule() {
+        if (!config.alignToWallClock) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now < nextRealign) {
+            return;
+        }
+        nextRealign = now + std::chrono::milliseconds(kRealignIntervalMs);
+        size_t moved = scheduler->realign(alignedOffsets(scheduleCycles, scheduleStagger, config.staggerWindowMs), now);
+        if (moved > 0) {
+            std::cerr << "Channel " << config.uuid << ": realigned " << moved << " devices to the wall clock" << std::endl;
+        }
+    }
+};
 
-    // 加载串口配置文件
+class SerialManager{
+private:
+    SerialReactor::ptr reactor;
+    RedisPool::ptr redisPool;
+    LatestValueCache::ptr latestValues;
+    ReadingCache::ptr readings;
+    TimeIndexQuery::ptr timeIndex;
+    FileWriter::ptr files;
+    bool warmStart = true;
+    std::vector<SerialChannel::ptr> channels;
+    // 配置了 journal.dir 时每个通道一个预写日志，由 checkpointer 定期落盘和确认
+    std::vector<SampleJournal::ptr> journals;
+    JournalCheckpointer::ptr checkpointer;
+
+public:
+    using ptr =  std::shared_ptr<SerialManager>;
+    SerialManager() : reactor(std::make_shared<SerialReactor>()), redisPool(std::make_shared<RedisPool>(RedisConfig(), std::vector<RedisEndpoint>())),
+                      readings(std::make_shared<ReadingCache>()), files(std::make_shared<FileWriter>()) {
+        loadSerialConfig("serial_config.json");
+
+        loadDevicesFromSerials();
+    }
+
+    // 加载串口配置文件，每个串口创建一个采集通道
     bool loadSerialConfig(const std::string& filename) {
         std::ifstream file(filename);
         if (!file.is_open()) {
@@ -284,10 +1411,130 @@ public:
         Json::Value root;
         file >> root;
 
+        FileSinkConfig filesConfig;
+        const Json::Value& filesJson = root["files"];
+        filesConfig.directory = filesJson.get("directory", filesConfig.directory).asString();
+        filesConfig.maxOpenFiles = filesJson.get("max-open", Json::UInt64(filesConfig.maxOpenFiles)).asUInt64();
+        filesConfig.bufferBytes = filesJson.get("buffer-size", Json::UInt64(filesConfig.bufferBytes >> 10)).asUInt64() << 10;
+        filesConfig.flushIntervalMs = filesJson.get("flush-interval", filesConfig.flushIntervalMs).asInt();
+        // format：text 只写txt，segment 只写分列文件(.seg)，both 两种都写
+        std::string format = filesJson.get("format", "text").asString();
+        SegmentStore::ptr segments;
+        if (format == "segment" || format == "both") {
+            SegmentConfig segmentConfig;
+            const Json::Value& segmentJson = filesJson["segment"];
+            segmentConfig.directory = filesConfig.directory;
+            segmentConfig.blockSamples = segmentJson.get("block-samples", segmentConfig.blockSamples).asUInt();
+            segmentConfig.flushIntervalMs = segmentJson.get("flush-interval", segmentConfig.flushIntervalMs).asInt();
+            // compression：gorilla（默认）或 none（定长列）
+            segmentConfig.compress = segmentJson.get("compression", "gorilla").asString() != "none";
+            segments = std::make_shared<SegmentStore>(segmentConfig);
+        } else if (format != "text") {
+            std::cerr << "Unknown files format: " << format << ", using text" << std::endl;
+        }
+        files = std::make_shared<FileWriter>(filesConfig, format != "segment", segments);
+
+        RedisConfig redis;
+        const Json::Value& redisJson = root["redis"];
+        redis.host = redisJson.get("host", redis.host).asString();
+        redis.port = redisJson.get("port", redis.port).asInt();
+        redis.batchSize = redisJson.get("batch-size", Json::UInt64(redis.batchSize)).asUInt64();
+        redis.flushIntervalMs = redisJson.get("flush-interval", redis.flushIntervalMs).asInt();
+        redis.window = redisJson.get("window", Json::UInt64(redis.window)).asUInt64();
+        redis.client = redisJson.get("client", redis.client).asString();
+        redis.storage = redisJson.get("storage", redis.storage).asString();
+        redis.historyMaxLen = redisJson["history"].get("maxlen", Json::UInt64(redis.historyMaxLen)).asUInt64();
+        redis.historyPrefix = redisJson["history"].get("prefix", redis.historyPrefix).asString();
+        const Json::Value& indexJson = redisJson["index"];
+        redis.indexRetentionMs = indexJson.get("retention", 0).asInt64() * 1000;
+        redis.indexPrefix = indexJson.get("prefix", redis.indexPrefix).asString();
+        redis.indexTrimEvery = indexJson.get("trim-every", redis.indexTrimEvery).asUInt();
+        const Json::Value& spoolJson = redisJson["spool"];
+        redis.spoolDir = spoolJson.get("dir", redis.spoolDir).asString();
+        redis.spoolSegmentBytes = spoolJson.get("segment-size", Json::UInt64(redis.spoolSegmentBytes >> 20)).asUInt64() << 20;
+        redis.spoolMaxBytes = spoolJson.get("max-size", Json::UInt64(redis.spoolMaxBytes >> 20)).asUInt64() << 20;
+        redis.replayRate = spoolJson.get("replay-rate", redis.replayRate).asInt();
+        std::vector<RedisEndpoint> endpoints;
+        for (const auto& endpoint : redisJson["endpoints"]) {
+            endpoints.push_back(RedisEndpoint{endpoint.get("host", redis.host).asString(), endpoint.get("port", redis.port).asInt()});
+        }
+        redisPool = std::make_shared<RedisPool>(redis, endpoints, redisJson.get("connections", 1).asUInt());
+        if (redis.indexRetentionMs > 0) {
+            timeIndex = std::make_shared<TimeIndexQuery>(redisPool);
+        }
+        warmStart = redisJson.get("warm-start", true).asBool();
+        int writeBehindMs = redisJson.get("write-behind", 0).asInt();
+        if (writeBehindMs > 0) {
+            latestValues = std::make_shared<LatestValueCache>(redisPool, writeBehindMs);
+        }
+
+        bool printSamples = root.get("print-samples", false).asBool();
         const Json::Value& devicesJson = root["devices"];
         for (const auto& deviceJson : devicesJson) {
-            std::string serialUUID = deviceJson["uuid"].asString();
-            serialUUIDs.push_back(serialUUID);
+            SerialChannelConfig config;
+            config.printSamples = printSamples;
+            config.uuid = deviceJson["uuid"].asString();
+            config.key = deviceJson["key"].asString();
+            config.alias = deviceJson["alias"].asString();
+            config.modelType = deviceJson["model-type"].asString();
+            config.fetchType = deviceJson["fetch-type"].asString();
+            config.alignToWallClock = deviceJson.get("align-to-wall-clock", false).asBool();
+            config.staggerWindowMs = deviceJson.get("stagger-window", config.staggerWindowMs).asInt();
+            config.atomicSnapshot = deviceJson.get("atomic-snapshot", false).asBool();
+            config.dimmingFrame = deviceJson.get("dimming-frame", "").asString();
+
+            const Json::Value& dev = deviceJson["dev"];
+            config.dev.instance = dev["instance"].asString();
+            config.dev.baudRate = dev.get("baud-rate", config.dev.baudRate).asInt();
+            config.dev.dataBits = dev.get("data-bits", config.dev.dataBits).asInt();
+            config.dev.parity = dev.get("parity", config.dev.parity).asString();
+            config.dev.stopBits = dev.get("stop-bits", config.dev.stopBits).asString();
+            config.dev.responseTimeoutMs = dev.get("response-timeout", config.dev.responseTimeoutMs).asInt();
+            config.turnaroundMs = dev.get("turnaround", config.turnaroundMs).asInt();
+            config.mergeRegisterGaps = dev.get("merge-register-gaps", false).asBool();
+
+            channels.push_back(std::make_shared<SerialChannel>(config, reactor, redisPool, latestValues, readings, files));
+        }
+
+        // journal：采样分发前先写入 <dir>/<通道uuid>.wal，确认写入redis后才从日志中释放，进程崩溃重启后回放
+        const Json::Value& journalJson = root["journal"];
+        std::string journalDir = journalJson.get("dir", "").asString();
+        if (!journalDir.empty()) {
+            uint64_t journalBytes = journalJson.get("size", 16).asUInt64() << 20;
+            int syncIntervalMs = journalJson.get("sync-interval", 100).asInt();
+            int checkpointIntervalMs = journalJson.get("checkpoint-interval", 1000).asInt();
+            mkdir(journalDir.c_str(), 0755);
+            for (const auto& channel : channels) {
+                auto journal = std::make_shared<SampleJournal>(journalDir + "/" + channel->getConfig().uuid + ".wal", journalBytes);
+                if (!journal->open()) {
+                    continue;
+                }
+                channel->enableJournal(journal);
+                journals.push_back(journal);
+            }
+            // 检查点之前分发的数据：写回缓存至少完成一次刷新，所有redis连接上之前发出的命令都成功应答或已暂存
+            // （暂存文件在这里统一落盘一次），txt数据都已写到文件
+            LatestValueCache::ptr cache = latestValues;
+            RedisPool::ptr pool = redisPool;
+            FileWriter::ptr fileWriter = files;
+            int barrierTimeoutMs = std::max(checkpointIntervalMs, 1000);
+            // 分列文件的块在内存中攒满（最长 flush-interval）才写出，写分列文件时检查点要等到
+            // 通过之前交给写线程的采样都已写进块才确认
+            JournalCheckpointer::Persisted persisted;
+            if (fileWriter->writesSegments()) {
+                persisted = [fileWriter](JournalCheckpointer::Clock::time_point at){
+                    return fileWriter->segmentsPendingSince() > at;
+                };
+            }
+            checkpointer = std::make_shared<JournalCheckpointer>(journals, [cache, pool, fileWriter, barrierTimeoutMs](){
+                if (cache && !cache->waitFlushed(barrierTimeoutMs)) {
+                    return false;
+                }
+                if (!pool->waitSettled(barrierTimeoutMs) || !pool->syncSpools(barrierTimeoutMs)) {
+                    return false;
+                }
+                return fileWriter->waitWritten(barrierTimeoutMs);
+            }, syncIntervalMs, checkpointIntervalMs, persisted);
         }
 
         file.close();
@@ -297,9 +1544,9 @@ public:
 
     // 
     bool loadDevicesFromSerials() {
-        for (const auto& serialUUID : serialUUIDs) {
-            std::string deviceConfigFilename = serialUUID + ".json";
-            if (loadSingleDeviceFromFile(deviceConfigFilename)) {
+        for (const auto& channel : channels) {
+            std::string deviceConfigFilename = channel->getConfig().uuid + ".json";
+            if (channel->loadDevices()) {
                 std::cout << "Loaded device: " << deviceConfigFilename << std::endl;
             }else {
                 std::cerr << "Failed to load device: " << deviceConfigFilename << std::endl;
@@ -308,31 +1555,188 @@ public:
         return true;
     }
 
+    // 所有串口在同一个epoll循环中收发，每个通道再启动一个采集线程
+    void start() {
+        files->start();
+        redisPool->start();
+        if (warmStart) {
+            loadLastReadings();
+        }
+        if (latestValues) {
+            latestValues->start();
+        }
+        for (const auto& channel : channels) {
+            channel->recoverJournal();
+        }
+        if (checkpointer) {
+            checkpointer->start();
+        }
+        for (const auto& channel : channels) {
+            channel->openPort();
+        }
+        reactor->start();
+        for (const auto& channel : channels) {
+            channel->start();
+        }
+    }
 
-    
-    // 模拟并发送设备数据
-    void simulateAndSendDeviceData() {
-        while (true) {
-            for (const auto& uuid_device : deviceManager.getDevices()) {
-                const auto& device = uuid_device.second;
-                std::map<std::string, std::string> simulatedData = dataSimulator.simulateData(device);
-                std::cout << device.uuid << std::endl;
-               
-                dataAcquire->acquire(device.uuid, simulatedData);
-                std::cout << "acqu: " << device.acquisitionCycle << std::endl;
-        
-                // 按照设备的获取周期暂停
-                std::this_thread::sleep_for(std::chrono::milliseconds(device.acquisitionCycle));
-            }
+    // 按数据流向依次停止并写出缓冲的数据：采集线程（退出前提交快照）、串口、写回缓存、redis连接、
+    // 文件（txt缓冲区和分列文件的块），最后把预写日志落盘。没有写出确认的采样下次启动时从日志回放
+    void stop() {
+        for (const auto& channel : channels) {
+            channel->stop();
+        }
+        reactor->stop();
+        if (latestValues) {
+            latestValues->stop();
+        }
+        redisPool->stop();
+        files->stop();
+        if (checkpointer) {
+            checkpointer->stop();
         }
     }
 
     void updateDevicesAndSerialConfig(){
-        for(const auto& serialUUID : serialUUIDs){
-            std::string deviceConfigFilename = serialUUID + ".json";
-            //reload
-            deviceManager.loadDeviceFromFile(deviceConfigFilename);
+        for (const auto& channel : channels) {
+            channel->reload();
+        }
+    }
+
+    const RedisPool::ptr& getRedisPool() const {
+        return redisPool;
+    }
+
+    const LatestValueCache::ptr& getLatestValueCache() const {
+        return latestValues;
+    }
+
+    const ReadingCache::ptr& getReadingCache() const {
+        return readings;
+    }
+
+    // 未配置时间索引时为空
+    const TimeIndexQuery::ptr& getTimeIndex() const {
+        return timeIndex;
+    }
+
+    const FileWriter::ptr& getFileWriter() const {
+        return files;
+    }
+
+    // 启动时加载所有已配置设备上次写入redis的值，采集线程启动前完成
+    void loadLastReadings() {
+        std::vector<ReadingCache::Key> keys;
+        for (const auto& channel : channels) {
+            for (const auto& uuid : channel->deviceUuids()) {
+                keys.push_back(ReadingCache::Key{uuid, channel->getConfig().atomicSnapshot ? channel->getConfig().uuid : uuid});
+            }
+        }
+        size_t loaded = readings->loadFromRedis(*redisPool, keys);
+        std::cout << "Warm start: loaded " << loaded << " of " << keys.size() << " devices from redis in "
+                  << readings->warmLoadMs.load() << " ms" << std::endl;
+        for (const auto& channel : channels) {
+            channel->seedBaseline();
+        }
+    }
+
+    // 控制命令交给各通道，由通道按 uuid / location 选择自己的设备
+    void dispatchControl(const Json::Value& request) {
+        for (const auto& channel : channels) {
+            channel->control(request);
+        }
+    }
+
+    // 采集统计，按通道uuid分组
+    Json::Value collectStats() {
+        Json::Value stats;
+        stats["channels"] = Json::Value(Json::objectValue);
+        for (const auto& channel : channels) {
+            stats["channels"][channel->getConfig().uuid] = channel->collectStats();
+        }
+        // 每条redis连接的统计，按 host:port#连接序号 分组
+        stats["redis"] = Json::Value(Json::objectValue);
+        for (size_t i = 0; i < redisPool->size(); ++i) {
+            RedisWriter& writer = redisPool->writer(i);
+            const RedisWriter::Stats& redis = writer.getStats();
+            Json::Value item;
+            item["connected"] = writer.connected();
+            item["commands"] = Json::UInt64(redis.commands.load());
+            item["replies"] = Json::UInt64(redis.replies.load());
+            item["errors"] = Json::UInt64(redis.errors.load());
+            item["dropped"] = Json::UInt64(redis.dropped.load());
+            item["failed"] = Json::UInt64(redis.failed.load());
+            item["batches"] = Json::UInt64(redis.batches.load());
+            item["backpressure-waits"] = Json::UInt64(redis.backpressureWaits.load());
+            item["in-flight"] = Json::UInt64(writer.pending());
+            item["batch-size"] = redis.batchSize.toJson();
+            item["flush-latency-us"] = redis.flushLatencyUs.toJson();
+            if (const RedisSpool* spool = writer.getSpool()) {
+                const RedisSpool::Stats& spooled = spool->getStats();
+                int64_t oldestMs = spooled.oldestMs.load();
+                int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                item["spool"]["depth"] = Json::UInt64(spooled.depth.load());
+                item["spool"]["bytes"] = Json::UInt64(spooled.bytes.load());
+                item["spool"]["oldest-age-ms"] = Json::Int64(oldestMs > 0 ? nowMs - oldestMs : 0);
+                item["spool"]["spooled"] = Json::UInt64(spooled.spooled.load());
+                item["spool"]["replayed"] = Json::UInt64(spooled.replayed.load());
+                item["spool"]["replay-per-sec"] = Json::UInt64(redis.replayPerSec.load());
+                item["spool"]["superseded"] = Json::UInt64(redis.superseded.load());
+                item["spool"]["dropped"] = Json::UInt64(spooled.dropped.load());
+                item["spool"]["corrupted"] = Json::UInt64(spooled.corrupted.load());
+            }
+            stats["redis"][redisPool->nameOf(i)] = item;
+        }
+        const FileSink::Stats& fileStats = files->getSink()->getStats();
+        const FileWriter::Stats& writerStats = files->getStats();
+        stats["files"]["open"] = Json::UInt64(files->getSink()->openFiles());
+        stats["files"]["queue-depth"] = Json::UInt64(files->depth());
+        stats["files"]["enqueued"] = Json::UInt64(writerStats.enqueued.load());
+        stats["files"]["lag-us"] = Json::UInt64(writerStats.lagUs.load());
+        stats["files"]["lag-histogram-us"] = writerStats.lagHistogramUs.toJson();
+        stats["files"]["batch-size"] = writerStats.batchSize.toJson();
+        if (files->getSegments()) {
+            const SegmentStore::Stats& segmentStats = files->getSegments()->getStats();
+            stats["files"]["segments"]["samples"] = Json::UInt64(segmentStats.samples.load());
+            stats["files"]["segments"]["blocks"] = Json::UInt64(segmentStats.blocks.load());
+            stats["files"]["segments"]["bytes"] = Json::UInt64(segmentStats.bytes.load());
+            uint64_t columnBytes = segmentStats.columnBytes.load();
+            stats["files"]["segments"]["compression-ratio"] = columnBytes ? static_cast<double>(segmentStats.rawBytes.load()) / columnBytes : 0.0;
+            stats["files"]["segments"]["rotations"] = Json::UInt64(segmentStats.rotations.load());
+            stats["files"]["segments"]["truncated-bytes"] = Json::UInt64(segmentStats.truncatedBytes.load());
+            stats["files"]["segments"]["errors"] = Json::UInt64(segmentStats.errors.load());
+        }
+        stats["files"]["appends"] = Json::UInt64(fileStats.appends.load());
+        stats["files"]["bytes"] = Json::UInt64(fileStats.bytes.load());
+        stats["files"]["writes"] = Json::UInt64(fileStats.writes.load());
+        stats["files"]["opens"] = Json::UInt64(fileStats.opens.load());
+        stats["files"]["closes"] = Json::UInt64(fileStats.closes.load());
+        stats["files"]["evictions"] = Json::UInt64(fileStats.evictions.load());
+        stats["files"]["errors"] = Json::UInt64(fileStats.errors.load());
+        if (checkpointer) {
+            stats["journal"]["checkpoints"] = Json::UInt64(checkpointer->checkpoints.load());
+            stats["journal"]["failed-checkpoints"] = Json::UInt64(checkpointer->failedCheckpoints.load());
+            stats["journal"]["held-checkpoints"] = Json::UInt64(checkpointer->heldCheckpoints.load());
         }
+        stats["readings"]["devices"] = Json::UInt64(readings->size());
+        stats["readings"]["warm-loaded"] = Json::UInt64(readings->warmLoaded.load());
+        stats["readings"]["warm-load-ms"] = Json::UInt64(readings->warmLoadMs.load());
+        if (latestValues) {
+            const LatestValueCache::Stats& cache = latestValues->getStats();
+            Json::Value& item = stats["redis-write-behind"];
+            item["interval-ms"] = latestValues->getIntervalMs();
+            item["devices"] = Json::UInt64(latestValues->size());
+            item["updates"] = Json::UInt64(cache.updates.load());
+            item["coalesced"] = Json::UInt64(cache.coalesced.load());
+            item["flushes"] = Json::UInt64(cache.flushes.load());
+            item["slots-written"] = Json::UInt64(cache.slotsWritten.load());
+            item["fields-written"] = Json::UInt64(cache.fieldsWritten.load());
+            item["fields-skipped"] = Json::UInt64(cache.fieldsSkipped.load());
+            item["dirty-slots"] = cache.dirtySlots.toJson();
+            item["flush-duration-us"] = cache.flushDurationUs.toJson();
+        }
+        return stats;
     }
 };
 //SerialManager::ptr serialManager;
@@ -434,8 +1838,39 @@ private:
         return command.find("sensor") != std::string::npos;
     }
 
+    // 命令名后面可选的JSON参数，没有参数时 request 为空
+    static bool parseParameters(const std::string& command, Json::Value& request) {
+        size_t begin = command.find('{');
+        if (begin == std::string::npos) {
+            return true;
+        }
+        Json::CharReaderBuilder builder;
+        std::string errors;
+        std::istringstream in(command.substr(begin));
+        if (!Json::parseFromStream(builder, in, &request, &errors)) {
+            std::cerr << "Invalid command parameters: " << errors << std::endl;
+            return false;
+        }
+        return true;
+    }
+
     void handleControllerCommand(const std::string& command) {
-        // Process the controller command
+        // Process the controller command, e.g. controller{"location":"711","percentage":80}
+        size_t begin = command.find('{');
+        if (begin == std::string::npos) {
+            std::cerr << "Controller command without parameters: " << command << std::endl;
+            return;
+        }
+
+        Json::CharReaderBuilder builder;
+        Json::Value request;
+        std::string errors;
+        std::istringstream in(command.substr(begin));
+        if (!Json::parseFromStream(builder, in, &request, &errors)) {
+            std::cerr << "Invalid controller command: " << errors << std::endl;
+            return;
+        }
+        serialManager->dispatchControl(request);
     }
 
     void handleSensorCommand(const std::string& command) {
@@ -446,14 +1881,73 @@ private:
 
         if (command == "sensoruc") {
             uconfig.update();
+        } else if (command == "sensorstats") {
+            Json::StreamWriterBuilder writer;
+            feedBack.send(Json::writeString(writer, serialManager->collectStats()));
+        } else if (command.compare(0, 12, "sensorlatest") == 0) {
+            // latest 或 latest{"uuids":[...]}：从内存中的最新值直接应答，不读redis
+            Json::Value request;
+            if (!parseParameters(command, request)) {
+                return;
+            }
+            Json::Value response(Json::objectValue);
+            if (request.isMember("uuids")) {
+                for (const auto& uuid : request["uuids"]) {
+                    Json::Value value;
+                    if (serialManager->getReadingCache()->get(uuid.asString(), value)) {
+                        response[uuid.asString()] = value;
+                    }
+                }
+            } else {
+                response = serialManager->getReadingCache()->toJson();
+            }
+            Json::StreamWriterBuilder writer;
+            feedBack.send(Json::writeString(writer, response));
+        } else if (command.compare(0, 9, "sensorfb{") == 0) {
+            // fb{"uuids":[...],"from":...,"to":...,"limit":1000}：从时间索引按时间范围查询，不读取整个文件
+            // from/to 为毫秒时间戳或 "YYYY-MM-DDTHH:MM:SS"，省略时为全部时间
+            Json::Value request;
+            if (!parseParameters(command, request)) {
+                return;
+            }
+            const TimeIndexQuery::ptr& timeIndex = serialManager->getTimeIndex();
+            if (!timeIndex) {
+                std::cerr << "Range query requires redis.index to be configured" << std::endl;
+                return;
+            }
+            int64_t fromMs = 0;
+            int64_t toMs = std::numeric_limits<int64_t>::max();
+            if ((request.isMember("from") && !parseIndexTime(request["from"], fromMs)) ||
+                (request.isMember("to") && !parseIndexTime(request["to"], toMs))) {
+                std::cerr << "Invalid time range in fb command" << std::endl;
+                return;
+            }
+            size_t limit = request.get("limit", 1000).asUInt();
+            Json::Value uuids = request["uuids"];
+            if (uuids.empty()) {
+                uuids.append("29C5F44E0A49470FB06367CDC9724FD3");
+                uuids.append("B52F0A27BCE64509B51B723C35FEF877");
+            }
+            Json::Value response(Json::objectValue);
+            for (const auto& uuid : uuids) {
+                response[uuid.asString()] = timeIndex->range(uuid.asString(), fromMs, toMs, limit);
+            }
+            Json::StreamWriterBuilder writer;
+            feedBack.send(Json::writeString(writer, response));
         } else if (command == "sensorfb") {
-            std::ifstream file("29C5F44E0A49470FB06367CDC9724FD3.txt");
+            // 文件由后台线程缓冲写入，读之前等写线程把此前入队的数据都写到文件（最多等1s）
+            const FileWriter::ptr& files = serialManager->getFileWriter();
+            if (!files->waitWritten(1000)) {
+                std::cerr << "sensorfb: file writer did not catch up, feedback may be incomplete" << std::endl;
+            }
+            const std::string& directory = files->getSink()->getConfig().directory;
+            std::ifstream file(directory + "/29C5F44E0A49470FB06367CDC9724FD3.txt");
             std::stringstream buffer;
             buffer << file.rdbuf();
             std::string fileContent = buffer.str();
             file.close();
 
-            std::ifstream file1("B52F0A27BCE64509B51B723C35FEF877.txt");
+            std::ifstream file1(directory + "/B52F0A27BCE64509B51B723C35FEF877.txt");
             std::stringstream buffer1;
             buffer1 << file1.rdbuf();
             fileContent += buffer1.str();
@@ -472,7 +1966,8 @@ private:
     DataAcquire::ptr dataAcquire;
     CommandHandler::ptr commandHandler;
 public:
-    MQTTServer() : mosq(nullptr), dataAcquire(std::make_shared<DataAcquire>()), commandHandler(std::make_shared<CommandHandler>()) {
+    MQTTServer() : mosq(nullptr), dataAcquire(std::make_shared<DataAcquire>(serialManager->getRedisPool(), serialManager->getLatestValueCache(),
+                                                                serialManager->getReadingCache(), serialManager->getFileWriter())), commandHandler(std::make_shared<CommandHandler>()) {
         mosquitto_lib_init();
         mosq = mosquitto_new(nullptr, true, nullptr);
         if (!mosq) {
@@ -498,17 +1993,29 @@ public:
         mosquitto_subscribe(mosq, nullptr, SERIAL_DATA_TOPIC.c_str(), 0);
         mosquitto_subscribe(mosq, nullptr, COMMAND_TOPIC.c_str(), 0);
 
-        // Start the data acquisition thread
-        std::thread acquireDataThread([&](){
-            serialManager->simulateAndSendDeviceData();
-        });
-        acquireDataThread.detach();
+        // Start one data acquisition thread per serial channel
+        serialManager->start();
 
-        mosquitto_loop_forever(mosq, -1, 1);
+        // 与 mosquitto_loop_forever 相同，断开后每秒重连一次；每次最多阻塞1s，收到停止信号后返回
+        while (!stopRequested.load()) {
+            if (mosquitto_loop(mosq, 1000, 1) != MOSQ_ERR_SUCCESS && !stopRequested.load()) {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                mosquitto_reconnect(mosq);
+            }
+        }
+        mosquitto_disconnect(mosq);
+        serialManager->stop();
+    }
+
+    // SIGTERM/SIGINT：只设置标志，由 start 中的事件循环返回后按顺序停止
+    static void requestStop(int) {
+        stopRequested.store(true);
     }
 
     
     private:
+    static std::atomic<bool> stopRequested;
+
     static void message_callback(struct mosquitto* mosq, void* userdata, const struct mosquitto_message* message) {
         std::cout << "Message received" << std::endl;
         std::cout << "  - Topic: " << message->topic << std::endl;
@@ -531,7 +2038,16 @@ public:
     }
 };
 
+std::atomic<bool> MQTTServer::stopRequested{false};
+
 int main() {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = MQTTServer::requestStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+
     MQTTServer server;
     server.start("127.0.0.1", 1883);
     return 0;
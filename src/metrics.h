@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <json/json.h>
+
+// 以2的幂为桶边界的直方图，record() 无锁，可在采集线程中直接调用
+// 第i个桶统计 [2^(i-1), 2^i) 范围内的值，第0个桶只统计0
+class Histogram {
+public:
+    Histogram() {
+        reset();
+    }
+
+    void record(uint64_t value) {
+        int bucket = 0;
+        while (bucket < kBuckets - 1 && value >= (1ull << bucket)) {
+            ++bucket;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t current = maxValue.load(std::memory_order_relaxed);
+        while (value > current && !maxValue.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (int i = 0; i < kBuckets; ++i) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        maxValue.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    // 返回p分位所在桶的上界，p取值0~1
+    uint64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p * n);
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                return i == 0 ? 0 : (1ull << i) - 1;
+            }
+        }
+        return maxValue.load(std::memory_order_relaxed);
+    }
+
+    Json::Value toJson() const {
+        Json::Value json;
+        uint64_t n = count();
+        json["count"] = Json::UInt64(n);
+        json["avg"] = n ? static_cast<double>(sum.load(std::memory_order_relaxed)) / n : 0.0;
+        json["p50"] = Json::UInt64(percentile(0.50));
+        json["p99"] = Json::UInt64(percentile(0.99));
+        json["max"] = Json::UInt64(maxValue.load(std::memory_order_relaxed));
+        return json;
+    }
+
+private:
+    enum { kBuckets = 40 };
+
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maxValue;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "serial_port.h"
+
+enum ModbusFunction : uint8_t {
+    MODBUS_READ_HOLDING_REGISTERS = 0x03,
+    MODBUS_READ_INPUT_REGISTERS = 0x04,
+};
+
+enum class ModbusStatus {
+    Ok,
+    Timeout,
+    CrcError,
+    BadFrame,
+    Exception,
+};
+
+inline uint16_t modbusCrcUpdate(uint16_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0xA001) : static_cast<uint16_t>(crc >> 1);
+    }
+    return crc;
+}
+
+inline uint16_t modbusCrc16(const uint8_t* data, size_t size) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc = modbusCrcUpdate(crc, data[i]);
+    }
+    return crc;
+}
+
+// 帧尾两个字节为低字节在前的CRC
+inline bool modbusCrcValid(const uint8_t* frame, size_t size) {
+    if (size < 4) {
+        return false;
+    }
+    uint16_t crc = modbusCrc16(frame, size - 2);
+    return frame[size - 2] == (crc & 0xFF) && frame[size - 1] == (crc >> 8);
+}
+
+inline void appendModbusCrc(std::vector<uint8_t>& frame) {
+    uint16_t crc = modbusCrc16(frame.data(), frame.size());
+    frame.push_back(static_cast<uint8_t>(crc & 0xFF));
+    frame.push_back(static_cast<uint8_t>(crc >> 8));
+}
+
+// 一个设备需要读取的寄存器范围，owner 由调用者定义（一般是设备下标）
+struct ModbusReadSpec {
+    uint8_t slave = 0;
+    uint8_t function = MODBUS_READ_HOLDING_REGISTERS;
+    uint16_t start = 0;
+    uint16_t count = 0;
+    uint32_t owner = 0;
+};
+
+// 合并后的一次读请求，members 记录每个设备在应答寄存器中的位置
+struct ModbusReadRequest {
+    struct Member {
+        uint32_t owner;
+        uint16_t offset;
+        uint16_t count;
+    };
+
+    uint8_t slave = 0;
+    uint8_t function = MODBUS_READ_HOLDING_REGISTERS;
+    uint16_t start = 0;
+    uint16_t count = 0;
+    std::vector<Member> members;
+
+    // 请求帧固定8字节，应答帧为 地址+功能码+字节数+数据+CRC
+    size_t requestLength() const { return 8; }
+    size_t responseLength() const { return 5 + 2 * static_cast<size_t>(count); }
+};
+
+// 把同一从站、同一功能码下相邻或重叠的寄存器范围合并成尽量少的请求
+// maxGap 允许合并时跨过的空洞寄存器数，单个请求不超过 maxRegisters（协议上限125）
+inline std::vector<ModbusReadRequest> planModbusReads(std::vector<ModbusReadSpec> specs,
+                                                      uint16_t maxRegisters = 125, uint16_t maxGap = 0) {
+    std::sort(specs.begin(), specs.end(), [](const ModbusReadSpec& a, const ModbusReadSpec& b) {
+        if (a.slave != b.slave) return a.slave < b.slave;
+        if (a.function != b.function) return a.function < b.function;
+        return a.start < b.start;
+    });
+
+    std::vector<ModbusReadRequest> requests;
+    for (const auto& spec : specs) {
+        if (spec.count == 0) {
+            continue;
+        }
+        uint32_t specEnd = static_cast<uint32_t>(spec.start) + spec.count;
+        if (!requests.empty()) {
+            ModbusReadRequest& last = requests.back();
+            uint32_t lastEnd = static_cast<uint32_t>(last.start) + last.count;
+            uint32_t mergedEnd = std::max(lastEnd, specEnd);
+            if (last.slave == spec.slave && last.function == spec.function &&
+                spec.start <= lastEnd + maxGap && mergedEnd - last.start <= maxRegisters) {
+                last.count = static_cast<uint16_t>(mergedEnd - last.start);
+                last.members.push_back({spec.owner, static_cast<uint16_t>(spec.start - last.start), spec.count});
+                continue;
+            }
+        }
+        ModbusReadRequest request;
+        request.slave = spec.slave;
+        request.function = spec.function;
+        request.start = spec.start;
+        request.count = spec.count;
+        request.members.push_back({spec.owner, 0, spec.count});
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+inline std::vector<uint8_t> buildModbusReadFrame(const ModbusReadRequest& request) {
+    std::vector<uint8_t> frame;
+    frame.reserve(request.requestLength());
+    frame.push_back(request.slave);
+    frame.push_back(request.function);
+    frame.push_back(static_cast<uint8_t>(request.start >> 8));
+    frame.push_back(static_cast<uint8_t>(request.start & 0xFF));
+    frame.push_back(static_cast<uint8_t>(request.count >> 8));
+    frame.push_back(static_cast<uint8_t>(request.count & 0xFF));
+    appendModbusCrc(frame);
+    return frame;
+}
+
+// 校验应答并取出寄存器值（大端）
+inline ModbusStatus parseModbusReadResponse(const ModbusReadRequest& request, const uint8_t* frame, size_t size,
+                                            std::vector<uint16_t>& registers) {
+    registers.clear();
+    if (size == 0) {
+        return ModbusStatus::Timeout;
+    }
+    if (size >= 5 && frame[0] == request.slave && frame[1] == (request.function | 0x80)) {
+        return modbusCrcValid(frame, 5) ? ModbusStatus::Exception : ModbusStatus::CrcError;
+    }
+    if (size < request.responseLength()) {
+        return ModbusStatus::BadFrame;
+    }
+    size = request.responseLength();
+    if (!modbusCrcValid(frame, size)) {
+        return ModbusStatus::CrcError;
+    }
+    if (frame[0] != request.slave || frame[1] != request.function || frame[2] != 2 * request.count) {
+        return ModbusStatus::BadFrame;
+    }
+    registers.reserve(request.count);
+    for (uint16_t i = 0; i < request.count; ++i) {
+        registers.push_back(static_cast<uint16_t>((frame[3 + 2 * i] << 8) | frame[4 + 2 * i]));
+    }
+    return ModbusStatus::Ok;
+}
+
+// Modbus RTU 主站
+class ModbusRtuMaster {
+public:
+    struct Stats {
+        std::atomic<uint64_t> transactions{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> crcErrors{0};
+        std::atomic<uint64_t> badFrames{0};
+        std::atomic<uint64_t> exceptions{0};
+    };
+
+    ModbusRtuMaster(SerialTransport& transport, const SerialPortConfig& config)
+        : transport(transport), config(config) {}
+
+    // 执行一次合并读请求，成功时registers为整个请求范围的寄存器值
+    ModbusStatus read(const ModbusReadRequest& request, std::vector<uint16_t>& registers) {
+        std::vector<uint8_t> frame = buildModbusReadFrame(request);
+        // 超时 = 应答帧在线上的传输时间 + 从站响应时间
+        int timeoutMs = config.responseTimeoutMs +
+                        static_cast<int>(config.charsToMicros(static_cast<double>(request.responseLength())) / 1000);
+
+        stats.transactions.fetch_add(1, std::memory_order_relaxed);
+        ModbusStatus status;
+        if (!transport.transact(frame, request.responseLength(), response, timeoutMs, completedAt)) {
+            registers.clear();
+            status = ModbusStatus::Timeout;
+        } else {
+            status = parseModbusReadResponse(request, response.data(), response.size(), registers);
+        }
+
+        switch (status) {
+            case ModbusStatus::Timeout: stats.timeouts.fetch_add(1, std::memory_order_relaxed); break;
+            case ModbusStatus::CrcError: stats.crcErrors.fetch_add(1, std::memory_order_relaxed); break;
+            case ModbusStatus::BadFrame: stats.badFrames.fetch_add(1, std::memory_order_relaxed); break;
+            case ModbusStatus::Exception: stats.exceptions.fetch_add(1, std::memory_order_relaxed); break;
+            default: break;
+        }
+        return status;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+    // 上一次read收到应答的时刻
+    std::chrono::steady_clock::time_point lastCompletedAt() const { return completedAt; }
+
+private:
+    SerialTransport& transport;
+    SerialPortConfig config;
+    std::vector<uint8_t> response;
+    std::chrono::steady_clock::time_point completedAt;
+    Stats stats;
+};
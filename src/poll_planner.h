@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "modbus_rtu.h"
+
+// 一次Modbus读事务占用总线的时间(us)：请求和应答在线上的传输时间 + 前后两个帧间隔 + 从站响应时间
+inline int64_t modbusTransactionCostUs(const SerialPortConfig& port, const ModbusReadRequest& request, int64_t turnaroundUs) {
+    return port.charsToMicros(static_cast<double>(request.requestLength() + request.responseLength())) +
+           2 * port.interFrameMicros() + turnaroundUs;
+}
+
+// 合并时值得跨过的空洞寄存器数：多读的寄存器在线上的时间不超过单独一次请求的固定开销
+inline uint16_t modbusBreakEvenGap(const SerialPortConfig& port, int64_t turnaroundUs) {
+    ModbusReadRequest empty;
+    int64_t overheadUs = modbusTransactionCostUs(port, empty, turnaroundUs);
+    int64_t perRegisterUs = std::max<int64_t>(port.charsToMicros(2.0), 1);
+    return static_cast<uint16_t>(std::min<int64_t>(overheadUs / perRegisterUs, 125));
+}
+
+// 按总线时间规划的轮询计划
+struct PollPlan {
+    std::vector<int> offsetsMs;      // 每个设备在自己周期内的起始相位
+    std::vector<int64_t> costUs;     // 每个设备分摊到的单次轮询总线时间
+    double projectedUtilization = 0; // 预计总线占用率，超过1表示超额订阅
+    double requestsPerSecond = 0;
+
+    bool oversubscribed() const { return projectedUtilization > 1.0; }
+};
+
+// 根据波特率和寄存器数计算每个设备的轮询开销和整条总线的占用率，并把各设备的起始相位错开。
+// 同一从站、同一功能码、同一周期的设备共用相位，保证每次都能合并成一个请求；
+// 不同的组按开销依次首尾相接地排在时间线上，避免同一tick里堆积大量请求而其他时间总线空闲。
+// specs[i].owner 为设备下标，cycles 为所有设备的周期(ms)，不在 specs 中的设备相位为0
+inline PollPlan planPolls(const SerialPortConfig& port, const std::vector<ModbusReadSpec>& specs,
+                          const std::vector<int>& cycles, int64_t turnaroundUs, uint16_t maxGap, int tickMs) {
+    PollPlan plan;
+    plan.offsetsMs.assign(cycles.size(), 0);
+    plan.costUs.assign(cycles.size(), 0);
+
+    // 周期短的组先排，它们在时间线上重复得最频繁
+    typedef std::tuple<int, uint8_t, uint8_t> GroupKey;
+    std::map<GroupKey, std::vector<ModbusReadSpec>> groups;
+    for (const auto& spec : specs) {
+        if (spec.owner >= cycles.size()) {
+            continue;
+        }
+        groups[GroupKey(std::max(cycles[spec.owner], 1), spec.slave, spec.function)].push_back(spec);
+    }
+
+    int64_t cursorUs = 0;
+    for (const auto& group : groups) {
+        int cycleMs = std::get<0>(group.first);
+        int64_t groupCostUs = 0;
+        size_t requests = 0;
+        for (const auto& request : planModbusReads(group.second, 125, maxGap)) {
+            int64_t cost = modbusTransactionCostUs(port, request, turnaroundUs);
+            groupCostUs += cost;
+            ++requests;
+            for (const auto& member : request.members) {
+                plan.costUs[member.owner] += cost / static_cast<int64_t>(request.members.size());
+            }
+        }
+
+        int offset = static_cast<int>((cursorUs / 1000) % cycleMs);
+        if (tickMs > 1) {
+            offset = offset / tickMs * tickMs;
+        }
+        for (const auto& spec : group.second) {
+            plan.offsetsMs[spec.owner] = offset;
+        }
+        cursorUs += groupCostUs;
+        plan.projectedUtilization += static_cast<double>(groupCostUs) / (cycleMs * 1000.0);
+        plan.requestsPerSecond += requests * 1000.0 / cycleMs;
+    }
+    return plan;
+}
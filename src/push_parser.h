@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "modbus_rtu.h"
+
+// 固定容量的字节环形缓冲区，容量为2的幂，按下标直接访问以便原地解析
+template <size_t Capacity>
+class ByteRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "ByteRing capacity must be a power of two");
+
+public:
+    ByteRing() : head(0), tail(0) {}
+
+    size_t size() const { return static_cast<size_t>(tail - head); }
+    size_t space() const { return Capacity - size(); }
+    bool empty() const { return head == tail; }
+
+    uint8_t at(size_t index) const { return buffer[(head + index) & (Capacity - 1)]; }
+
+    void consume(size_t n) { head += n; }
+
+    // 从fd直接读到空闲区（最多两段），返回read的结果
+    ssize_t readFrom(int fd) {
+        size_t free = space();
+        if (free == 0) {
+            return 0;
+        }
+        size_t start = static_cast<size_t>(tail & (Capacity - 1));
+        size_t first = std::min(free, Capacity - start);
+        struct iovec iov[2];
+        iov[0].iov_base = buffer + start;
+        iov[0].iov_len = first;
+        iov[1].iov_base = buffer;
+        iov[1].iov_len = free - first;
+        ssize_t n = ::readv(fd, iov, free > first ? 2 : 1);
+        if (n > 0) {
+            tail += static_cast<uint64_t>(n);
+        }
+        return n;
+    }
+
+    size_t write(const uint8_t* data, size_t size) {
+        size_t n = std::min(size, space());
+        for (size_t i = 0; i < n; ++i) {
+            buffer[(tail + i) & (Capacity - 1)] = data[i];
+        }
+        tail += n;
+        return n;
+    }
+
+private:
+    uint8_t buffer[Capacity];
+    uint64_t head;
+    uint64_t tail;
+};
+
+// 主动上报的一帧寄存器数据
+struct PushFrame {
+    uint8_t slave = 0;
+    uint8_t function = 0;
+    uint8_t count = 0;
+    uint16_t registers[125];
+    // 收到帧最后一段数据的时刻
+    std::chrono::steady_clock::time_point capturedAt;
+};
+
+// 主动上报(fetch-type: push)通道的流式帧解析器
+// 帧格式与 Modbus RTU 读寄存器应答相同：地址 + 功能码 + 字节数 + 数据 + CRC。
+// 字节直接读入环形缓冲区并在其中原地解析，CRC错误或无法识别时丢弃一个字节重新同步。
+class PushFrameParser : public SerialStreamReader {
+public:
+    using FrameHandler = std::function<void(const PushFrame& frame)>;
+
+    struct Stats {
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> exceptions{0};
+        std::atomic<uint64_t> crcErrors{0};
+        std::atomic<uint64_t> resyncs{0};
+        std::atomic<uint64_t> overflows{0};
+    };
+
+    explicit PushFrameParser(const FrameHandler& handler) : handler(handler) {}
+
+    ssize_t readFrom(int fd) override {
+        if (ring.space() == 0) {
+            // 缓冲区满说明其中没有可识别的帧，丢弃一半重新同步
+            stats.overflows.fetch_add(1, std::memory_order_relaxed);
+            ring.consume(ring.size() / 2);
+        }
+        ssize_t n = ring.readFrom(fd);
+        if (n > 0) {
+            receivedAt = std::chrono::steady_clock::now();
+            stats.bytes.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+            parse();
+        }
+        return n;
+    }
+
+    // 总线静默超过 t3.5 时，剩下的不完整数据不可能再拼成一帧
+    void onSilence() override {
+        while (!ring.empty()) {
+            resync();
+            parse();
+        }
+    }
+
+    void feed(const uint8_t* data, size_t size) {
+        receivedAt = std::chrono::steady_clock::now();
+        while (size > 0) {
+            size_t n = ring.write(data, size);
+            if (n == 0) {
+                stats.overflows.fetch_add(1, std::memory_order_relaxed);
+                ring.consume(ring.size() / 2);
+                continue;
+            }
+            stats.bytes.fetch_add(n, std::memory_order_relaxed);
+            data += n;
+            size -= n;
+            parse();
+        }
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    ByteRing<4096> ring;
+    FrameHandler handler;
+    PushFrame frame;
+    std::chrono::steady_clock::time_point receivedAt;
+    Stats stats;
+
+    void parse() {
+        while (ring.size() >= 5) {
+            uint8_t slave = ring.at(0);
+            uint8_t function = ring.at(1);
+            if (slave == 0 || slave > 247) {
+                resync();
+                continue;
+            }
+
+            size_t length;
+            if (function == MODBUS_READ_HOLDING_REGISTERS || function == MODBUS_READ_INPUT_REGISTERS) {
+                uint8_t byteCount = ring.at(2);
+                if (byteCount == 0 || (byteCount & 1) || byteCount > 250) {
+                    resync();
+                    continue;
+                }
+                length = 5 + static_cast<size_t>(byteCount);
+            } else if (function == (MODBUS_READ_HOLDING_REGISTERS | 0x80) ||
+                       function == (MODBUS_READ_INPUT_REGISTERS | 0x80)) {
+                length = 5;
+            } else {
+                resync();
+                continue;
+            }
+
+            if (ring.size() < length) {
+                return;
+            }
+            if (!crcValid(length)) {
+                stats.crcErrors.fetch_add(1, std::memory_order_relaxed);
+                resync();
+                continue;
+            }
+
+            if (function & 0x80) {
+                stats.exceptions.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                frame.slave = slave;
+                frame.function = function;
+                frame.count = static_cast<uint8_t>(ring.at(2) / 2);
+                for (uint8_t i = 0; i < frame.count; ++i) {
+                    frame.registers[i] = static_cast<uint16_t>((ring.at(3 + 2 * i) << 8) | ring.at(4 + 2 * i));
+                }
+                frame.capturedAt = receivedAt;
+                stats.frames.fetch_add(1, std::memory_order_relaxed);
+                handler(frame);
+            }
+            ring.consume(length);
+        }
+    }
+
+    bool crcValid(size_t length) const {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length - 2; ++i) {
+            crc = modbusCrcUpdate(crc, ring.at(i));
+        }
+        return ring.at(length - 2) == (crc & 0xFF) && ring.at(length - 1) == (crc >> 8);
+    }
+
+    void resync() {
+        ring.consume(1);
+        stats.resyncs.fetch_add(1, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cpp_redis/cpp_redis>
+#include <json/json.h>
+#include "redis_pool.h"
+#include "sample.h"
+
+// 每个设备最近一次采到的值，供查询和反馈直接读取
+// 启动时从redis批量加载上次运行写入的最新值（warm start），之后每次采集覆盖；慢速设备在重启后的第一个周期内也有值可查。
+class ReadingCache {
+public:
+    using ptr = std::shared_ptr<ReadingCache>;
+
+    // key 为设备uuid，route 为写入时选择redis实例用的key（快照模式下为通道uuid）
+    struct Key {
+        std::string uuid;
+        std::string route;
+    };
+
+    ReadingCache() : warmLoaded(0), warmLoadMs(0), devices(0) {}
+
+    void update(const std::string& uuid, const Json::Value& value) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.values.emplace(uuid, value);
+        if (result.second) {
+            devices.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            result.first->second = value;
+        }
+    }
+
+    // 采集线程调用：在缓存的值上逐个字段覆盖，字段不变时不重建整个对象
+    void update(const std::string& uuid, const SampleText& sample) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.values.emplace(uuid, Json::Value(Json::objectValue));
+        Json::Value& value = result.first->second;
+        if (result.second) {
+            devices.fetch_add(1, std::memory_order_relaxed);
+        } else if (value.size() != sample.count + 2) {
+            // 字段表变了，去掉不再采集的字段
+            value = Json::Value(Json::objectValue);
+        }
+        for (size_t i = 0; i < sample.count; ++i) {
+            value[sample.name(i)] = sample.values[i];
+        }
+        value["timestamp"] = sample.timestamp;
+        value["captured-at"] = Json::Int64(sample.capturedAtMs);
+    }
+
+    bool get(const std::string& uuid, Json::Value& value) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.values.find(uuid);
+        if (it == shard.values.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    // 所有设备的值，按uuid分组
+    Json::Value toJson() {
+        Json::Value json(Json::objectValue);
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& kv : shard.values) {
+                json[kv.first] = kv.second;
+            }
+        }
+        return json;
+    }
+
+    // 按写入时的实例分组，json 存储每个实例每 kChunk 个key一条 MGET，hash 存储每个设备一条 HGETALL，
+    // 同一实例的命令一次pipeline发出。已经有值的设备（启动后已采到）不覆盖。返回加载的设备数
+    size_t loadFromRedis(RedisPool& pool, const std::vector<Key>& keys, int timeoutMs = 3000) {
+        auto begin = std::chrono::steady_clock::now();
+        bool hash = pool.getConfig().storage == "hash";
+        std::vector<std::vector<std::string>> byEndpoint(pool.endpoints().size());
+        for (const auto& key : keys) {
+            byEndpoint[pool.endpointFor(key.route)].push_back(key.uuid);
+        }
+
+        size_t loaded = 0;
+        for (size_t e = 0; e < byEndpoint.size(); ++e) {
+            const std::vector<std::string>& uuids = byEndpoint[e];
+            if (uuids.empty()) {
+                continue;
+            }
+            const RedisEndpoint& endpoint = pool.endpoints()[e];
+            cpp_redis::client client;
+            try {
+                client.connect(endpoint.host, static_cast<size_t>(endpoint.port));
+            } catch (const std::exception& ex) {
+                std::cerr << "Warm start: failed to connect to redis " << endpoint.host << ":" << endpoint.port
+                          << ": " << ex.what() << std::endl;
+                continue;
+            }
+
+            // 超时后迟到的应答仍可能回调，回调只引用共享的状态
+            std::shared_ptr<LoadState> state = std::make_shared<LoadState>();
+            state->uuids = uuids;
+            if (hash) {
+                for (size_t i = 0; i < uuids.size(); ++i) {
+                    client.send({"HGETALL", uuids[i]}, [state, i](cpp_redis::reply& reply) {
+                        Json::Value value;
+                        if (parseHash(reply, value)) {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            state->results.push_back(std::make_pair(state->uuids[i], value));
+                        }
+                    });
+                }
+            } else {
+                for (size_t i = 0; i < uuids.size(); i += kChunk) {
+                    std::vector<std::string> command{"MGET"};
+                    command.insert(command.end(), uuids.begin() + i, uuids.begin() + std::min<size_t>(i + kChunk, uuids.size()));
+                    client.send(command, [state, i](cpp_redis::reply& reply) {
+                        if (!reply.is_array()) {
+                            return;
+                        }
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        const std::vector<cpp_redis::reply>& values = reply.as_array();
+                        for (size_t j = 0; j < values.size() && i + j < state->uuids.size(); ++j) {
+                            Json::Value value;
+                            if (parseJson(values[j], value)) {
+                                state->results.push_back(std::make_pair(state->uuids[i + j], value));
+                            }
+                        }
+                    });
+                }
+            }
+            try {
+                client.sync_commit(std::chrono::milliseconds(timeoutMs));
+            } catch (const std::exception& ex) {
+                std::cerr << "Warm start: failed to read from redis: " << ex.what() << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            for (const auto& result : state->results) {
+                if (seed(result.first, result.second)) {
+                    ++loaded;
+                }
+            }
+            state->results.clear();
+        }
+        warmLoaded = loaded;
+        warmLoadMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - begin).count());
+        return loaded;
+    }
+
+    size_t size() const { return devices.load(std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> warmLoaded;
+    std::atomic<uint64_t> warmLoadMs;
+
+private:
+    enum { kShards = 16, kChunk = 500 };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Json::Value> values;
+    };
+
+    struct LoadState {
+        std::mutex mutex;
+        std::vector<std::string> uuids;
+        std::vector<std::pair<std::string, Json::Value>> results;
+    };
+
+    Shard shards[kShards];
+    std::atomic<size_t> devices;
+
+    Shard& shardOf(const std::string& uuid) {
+        return shards[redisKeyHash(uuid) % kShards];
+    }
+
+    bool seed(const std::string& uuid, const Json::Value& value) {
+        Shard& shard = shardOf(uuid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.values.emplace(uuid, value).second) {
+            return false;
+        }
+        devices.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    static bool parseJson(const cpp_redis::reply& reply, Json::Value& value) {
+        if (!reply.is_string()) {
+            return false;
+        }
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        const std::string& text = reply.as_string();
+        std::string errors;
+        return reader->parse(text.data(), text.data() + text.size(), &value, &errors) && value.isObject();
+    }
+
+    // HGETALL 的应答为 字段 值 交替的数组，空数组表示key不存在
+    static bool parseHash(const cpp_redis::reply& reply, Json::Value& value) {
+        if (!reply.is_array() || reply.as_array().empty()) {
+            return false;
+        }
+        const std::vector<cpp_redis::reply>& items = reply.as_array();
+        for (size_t i = 0; i + 1 < items.size(); i += 2) {
+            if (items[i].is_string() && items[i + 1].is_string()) {
+                value[items[i].as_string()] = items[i + 1].as_string();
+            }
+        }
+        return value.isObject();
+    }
+};
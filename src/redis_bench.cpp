@@ -0,0 +1,181 @@
+// redis 写入微基准
+// 用生产中的 RedisWriter 分别以 cpp_redis 和 resp 客户端写 SET / HSET / XADD 命令，从 send 开始到全部应答返回计算吞吐，
+// 以及不经过网络时构造参数数组再编码（RedisWriter 的做法）与直接编码一条命令的耗时。需要一个可写的redis，会写入 bench: 前缀的key。
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include "redis_writer.h"
+#include "resp.h"
+
+struct BenchOptions {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    int count = 200000;
+    int batch = 256;
+};
+
+enum Workload { SET, HSET, XADD };
+
+const char* workloadName(Workload workload) {
+    switch (workload) {
+        case SET: return "SET";
+        case HSET: return "HSET";
+        default: return "XADD";
+    }
+}
+
+// 按 cpp_redis 的方式为每条命令构造参数数组
+std::vector<std::string> makeCommand(Workload workload, int i) {
+    std::string key = "bench:" + std::to_string(i % 1000);
+    switch (workload) {
+        case SET:
+            return {"SET", key, "{\"temperature\":\"23.5\",\"humidity\":\"41\",\"timestamp\":\"2024-01-01T00:00:00Z\"}"};
+        case HSET:
+            return {"HSET", key, "temperature", "23.5", "humidity", std::to_string(i % 100), "captured-at", std::to_string(i)};
+        default:
+            return {"XADD", "bench:stream:" + std::to_string(i % 1000), "MAXLEN", "~", "1000", "*", "temperature", "23.5", "humidity", std::to_string(i % 100)};
+    }
+}
+
+// 直接编码进缓冲区，不构造中间对象；RedisWriter 不这样编码，只作为编码耗时的下限对比
+void encodeCommand(std::string& out, Workload workload, int i) {
+    switch (workload) {
+        case SET: {
+            static const char value[] = "{\"temperature\":\"23.5\",\"humidity\":\"41\",\"timestamp\":\"2024-01-01T00:00:00Z\"}";
+            resp::appendArrayHeader(out, 3);
+            resp::appendBulk(out, "SET", 3);
+            resp::appendBulk(out, i % 1000, "bench:", 6);
+            resp::appendBulk(out, value, sizeof(value) - 1);
+            break;
+        }
+        case HSET:
+            resp::appendArrayHeader(out, 8);
+            resp::appendBulk(out, "HSET", 4);
+            resp::appendBulk(out, i % 1000, "bench:", 6);
+            resp::appendBulk(out, "temperature", 11);
+            resp::appendBulk(out, "23.5", 4);
+            resp::appendBulk(out, "humidity", 8);
+            resp::appendBulk(out, i % 100);
+            resp::appendBulk(out, "captured-at", 11);
+            resp::appendBulk(out, i);
+            break;
+        default:
+            resp::appendArrayHeader(out, 10);
+            resp::appendBulk(out, "XADD", 4);
+            resp::appendBulk(out, i % 1000, "bench:stream:", 13);
+            resp::appendBulk(out, "MAXLEN", 6);
+            resp::appendBulk(out, "~", 1);
+            resp::appendBulk(out, "1000", 4);
+            resp::appendBulk(out, "*", 1);
+            resp::appendBulk(out, "temperature", 11);
+            resp::appendBulk(out, "23.5", 4);
+            resp::appendBulk(out, "humidity", 8);
+            resp::appendBulk(out, i % 100);
+            break;
+    }
+}
+
+double secondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// 采集线程的写法：每条命令 send 进 RedisWriter，等待写线程把全部命令发出并收到应答
+double benchWriter(const BenchOptions& options, Workload workload, const std::string& client, uint64_t& errors, uint64_t& dropped) {
+    RedisConfig config;
+    config.host = options.host;
+    config.port = options.port;
+    config.batchSize = static_cast<size_t>(options.batch);
+    config.client = client;
+    RedisWriter writer(config, "bench");
+    writer.start();
+    if (!writer.connected()) {
+        std::cerr << "Failed to connect to " << options.host << ":" << options.port << std::endl;
+        writer.stop();
+        return 0;
+    }
+    const RedisWriter::Stats& stats = writer.getStats();
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.count; ++i) {
+        writer.send(makeCommand(workload, i));
+    }
+    while (stats.settled.load() < static_cast<uint64_t>(options.count)) {
+        if (secondsSince(begin) > 60) {
+            std::cerr << "Timed out waiting for replies" << std::endl;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double seconds = secondsSince(begin);
+    errors = stats.errors.load();
+    dropped = stats.dropped.load();
+    writer.stop();
+    return options.count / seconds;
+}
+
+// 不经过网络，只比较构造参数数组再编码与直接编码的耗时(ns/条)
+void benchEncoding(Workload workload, int count) {
+    std::string out;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        if ((i & 1023) == 0) {
+            out.clear();
+        }
+        resp::appendCommand(out, makeCommand(workload, i));
+    }
+    double vectorNs = secondsSince(begin) * 1e9 / count;
+
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        if ((i & 1023) == 0) {
+            out.clear();
+        }
+        encodeCommand(out, workload, i);
+    }
+    double directNs = secondsSince(begin) * 1e9 / count;
+    std::cout << workloadName(workload) << " encode: vector<string> (RedisWriter) " << vectorNs << " ns, direct " << directNs << " ns" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    bool encodeOnly = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--count" && hasValue) {
+            options.count = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--batch" && hasValue) {
+            options.batch = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--encode-only") {
+            encodeOnly = true;
+        } else {
+            std::cout << "Usage: RedisBench [--host HOST] [--port PORT] [--count N] [--batch N] [--encode-only]" << std::endl;
+            return 1;
+        }
+    }
+
+    Workload workloads[] = {SET, HSET, XADD};
+    for (Workload workload : workloads) {
+        benchEncoding(workload, options.count);
+    }
+    if (encodeOnly) {
+        return 0;
+    }
+    const char* clients[] = {"cpp_redis", "resp"};
+    for (Workload workload : workloads) {
+        for (const char* client : clients) {
+            uint64_t errors = 0, dropped = 0;
+            double throughput = benchWriter(options, workload, client, errors, dropped);
+            std::cout << workloadName(workload) << " batch " << options.batch << " " << client << ": "
+                      << static_cast<uint64_t>(throughput) << " ops/s (" << errors << " errors, " << dropped << " dropped)" << std::endl;
+        }
+    }
+    return 0;
+}
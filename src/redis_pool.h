@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "redis_writer.h"
+
+struct RedisEndpoint {
+    std::string host;
+    int port;
+};
+
+// 32位 FNV-1a 再做一次 murmur3 的 finalizer，使相近的uuid也能均匀分布
+inline uint32_t redisKeyHash(const std::string& key, uint32_t seed = 2166136261u) {
+    uint32_t h = seed;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// 多个redis实例、每个实例多条连接的写连接池
+// 设备uuid按一致性哈希（每个实例 virtualNodes 个虚拟节点）映射到实例，增减实例时只有约 1/N 的设备换实例；
+// 同一个key总是落在同一条连接上，保证同一设备的命令按顺序写入。每条连接是一个独立pipeline的 RedisWriter。
+class RedisPool {
+public:
+    using ptr = std::shared_ptr<RedisPool>;
+
+    RedisPool(const RedisConfig& config, const std::vector<RedisEndpoint>& endpoints,
+              size_t connectionsPerEndpoint = 1, int virtualNodes = 160)
+        : config(config), connectionsPerEndpoint(std::max<size_t>(connectionsPerEndpoint, 1)) {
+        std::vector<RedisEndpoint>& list = endpointList;
+        list = endpoints;
+        if (list.empty()) {
+            list.push_back(RedisEndpoint{config.host, config.port});
+        }
+        for (size_t e = 0; e < list.size(); ++e) {
+            std::string endpoint = list[e].host + ":" + std::to_string(list[e].port);
+            for (int v = 0; v < virtualNodes; ++v) {
+                ring.push_back(std::make_pair(redisKeyHash(endpoint + "#" + std::to_string(v)), e));
+            }
+            for (size_t c = 0; c < this->connectionsPerEndpoint; ++c) {
+                RedisConfig connection = config;
+                connection.host = list[e].host;
+                connection.port = list[e].port;
+                // 暂存文件名不能带 ':'
+                std::string spoolName = list[e].host + "_" + std::to_string(list[e].port) + "_" + std::to_string(c);
+                writers.push_back(std::make_shared<RedisWriter>(connection, spoolName));
+                names.push_back(endpoint + "#" + std::to_string(c));
+            }
+        }
+        std::sort(ring.begin(), ring.end());
+    }
+
+    void start() {
+        for (const auto& writer : writers) {
+            writer->start();
+        }
+    }
+
+    void stop() {
+        for (const auto& writer : writers) {
+            writer->stop();
+        }
+    }
+
+    // 按key选择连接后写入
+    void send(const std::string& key, RedisCommand command) {
+        writerFor(key).send(std::move(command));
+    }
+
+    RedisWriter& writerFor(const std::string& key) {
+        return *writers[indexFor(key)];
+    }
+
+    size_t indexFor(const std::string& key) const {
+        return endpointFor(key) * connectionsPerEndpoint + redisKeyHash(key, 0x9747b28cu) % connectionsPerEndpoint;
+    }
+
+    size_t endpointFor(const std::string& key) const {
+        uint32_t h = redisKeyHash(key);
+        auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(h, static_cast<size_t>(0)));
+        if (it == ring.end()) {
+            it = ring.begin();
+        }
+        return it->second;
+    }
+
+    // 等到调用时刻之前 send 的命令在所有连接上都有了结果（应答、暂存或丢弃）。
+    // 只有全部成功应答或已写入暂存文件才返回true（暂存文件由 syncSpools 落盘）；超时，或者自上次调用以来
+    // 有命令收到错误应答或被丢弃时返回false。只由检查点线程调用
+    bool waitSettled(int timeoutMs) {
+        std::vector<uint64_t> sent;
+        for (const auto& writer : writers) {
+            sent.push_back(writer->getStats().commands.load());
+        }
+        checkedFailed.resize(writers.size(), 0);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (size_t i = 0; i < writers.size(); ++i) {
+            while (writers[i]->getStats().settled.load() < sent[i]) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        // 失败只让一次检查点失败，之后的检查点只看新的失败
+        bool settled = true;
+        for (size_t i = 0; i < writers.size(); ++i) {
+            uint64_t failed = writers[i]->getStats().failed.load();
+            if (failed != checkedFailed[i]) {
+                checkedFailed[i] = failed;
+                settled = false;
+            }
+        }
+        return settled;
+    }
+
+    // 所有连接的暂存文件各落盘一次，在 waitSettled 之后调用
+    bool syncSpools(int timeoutMs) {
+        bool synced = true;
+        for (const auto& writer : writers) {
+            synced = writer->syncSpool(timeoutMs) && synced;
+        }
+        return synced;
+    }
+
+    // 任意一条连接重新连上时变化
+    uint64_t connectionEpoch() const {
+        uint64_t epoch = 0;
+        for (const auto& writer : writers) {
+            epoch += writer->connectionEpoch();
+        }
+        return epoch;
+    }
+
+    const RedisConfig& getConfig() const { return config; }
+    // endpointFor 返回的下标对应这里的实例
+    const std::vector<RedisEndpoint>& endpoints() const { return endpointList; }
+    size_t size() const { return writers.size(); }
+    RedisWriter& writer(size_t index) { return *writers[index]; }
+    const std::string& nameOf(size_t index) const { return names[index]; }
+
+private:
+    RedisConfig config;
+    size_t connectionsPerEndpoint;
+    std::vector<RedisEndpoint> endpointList;
+    std::vector<std::pair<uint32_t, size_t>> ring;
+    std::vector<RedisWriter::ptr> writers;
+    std::vector<std::string> names;
+    // 上次 waitSettled 看到的每条连接的 failed
+    std::vector<uint64_t> checkedFailed;
+};
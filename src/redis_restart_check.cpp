@@ -0,0 +1,165 @@
+// redis 重启检查
+// 启动一个开启 AOF（appendfsync always）的 redis-server，用 RedisWriter 按固定速率写 SADD，写到三分之一时 kill -9 redis，
+// 停一段时间后用同一个数据目录重启。全部写完后等待暂存队列回放，检查集合中的成员数是否等于发出的命令数：
+// 断开时已发出未应答的命令和断开期间的命令都应通过暂存队列补写，少一条即失败（重复写入不影响集合）。
+// 需要 redis-server 在 PATH 中或用 --redis-server 指定；会在 --dir 下生成 AOF 和暂存文件。
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cpp_redis/cpp_redis>
+#include "redis_writer.h"
+
+struct CheckOptions {
+    std::string redisServer = "redis-server";
+    std::string dir = "restart-check";
+    std::string client = "resp";
+    int port = 6390;
+    int count = 30000;
+    int rate = 5000;
+    int downMs = 2000;
+    int timeoutMs = 60000;
+};
+
+const char* kCheckKey = "restart-check:members";
+
+pid_t startRedis(const CheckOptions& options) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::string port = std::to_string(options.port);
+        execlp(options.redisServer.c_str(), options.redisServer.c_str(), "--port", port.c_str(), "--dir", options.dir.c_str(),
+            "--save", "", "--appendonly", "yes", "--appendfsync", "always", static_cast<char*>(nullptr));
+        std::cerr << "Failed to start " << options.redisServer << std::endl;
+        _exit(127);
+    }
+    // 等到可以连接
+    for (int i = 0; i < 100; ++i) {
+        resp::Connection connection;
+        if (connection.connect("127.0.0.1", options.port, 100)) {
+            return pid;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    std::cerr << "redis-server did not start on port " << options.port << std::endl;
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return -1;
+}
+
+void stopRedis(pid_t pid, int signal) {
+    kill(pid, signal);
+    waitpid(pid, nullptr, 0);
+}
+
+// 同步执行一条命令，返回整数应答，失败返回 -1
+int64_t queryInteger(const CheckOptions& options, const std::vector<std::string>& command) {
+    cpp_redis::client client;
+    int64_t value = -1;
+    try {
+        client.connect("127.0.0.1", static_cast<size_t>(options.port));
+        client.send(command, [&value](cpp_redis::reply& reply) {
+            if (reply.is_integer()) {
+                value = reply.as_integer();
+            }
+        });
+        client.sync_commit(std::chrono::milliseconds(1000));
+    } catch (const std::exception& e) {
+        std::cerr << "Query failed: " << e.what() << std::endl;
+    }
+    return value;
+}
+
+bool parseOptions(int argc, char* argv[], CheckOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--redis-server" && hasValue) {
+            options.redisServer = argv[++i];
+        } else if (arg == "--dir" && hasValue) {
+            options.dir = argv[++i];
+        } else if (arg == "--client" && hasValue) {
+            options.client = argv[++i];
+        } else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--count" && hasValue) {
+            options.count = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rate" && hasValue) {
+            options.rate = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--down" && hasValue) {
+            options.downMs = std::max(0, std::atoi(argv[++i]));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    CheckOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: RedisRestartCheck [--redis-server PATH] [--dir DIR] [--client resp|cpp_redis] [--port PORT]"
+                  << " [--count N] [--rate N] [--down MS]" << std::endl;
+        return 1;
+    }
+    mkdir(options.dir.c_str(), 0755);
+
+    pid_t redis = startRedis(options);
+    if (redis < 0) {
+        return 1;
+    }
+    queryInteger(options, {"DEL", kCheckKey});
+
+    RedisConfig config;
+    config.port = options.port;
+    config.client = options.client;
+    config.batchSize = 64;
+    config.spoolDir = options.dir + "/spool";
+    RedisWriter writer(config, "restart-check");
+    writer.start();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.count; ++i) {
+        std::this_thread::sleep_until(begin + std::chrono::microseconds(static_cast<int64_t>(i) * 1000000 / options.rate));
+        if (i == options.count / 3) {
+            std::cout << "Killing redis after " << i << " commands" << std::endl;
+            stopRedis(redis, SIGKILL);
+            std::this_thread::sleep_for(std::chrono::milliseconds(options.downMs));
+            redis = startRedis(options);
+            if (redis < 0) {
+                writer.stop();
+                return 1;
+            }
+            std::cout << "Restarted redis" << std::endl;
+        }
+        writer.send({"SADD", kCheckKey, std::to_string(i)});
+    }
+
+    // 等待实时写入和暂存回放都完成
+    int64_t members = -1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeoutMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+        members = queryInteger(options, {"SCARD", kCheckKey});
+        if (members == options.count) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    const RedisWriter::Stats& stats = writer.getStats();
+    std::cout << "client " << options.client << ": sent " << options.count << ", members " << members
+              << ", errors " << stats.errors.load() << ", dropped " << stats.dropped.load() << std::endl;
+    writer.stop();
+    stopRedis(redis, SIGTERM);
+    if (members != options.count) {
+        std::cout << "FAILED: " << options.count - members << " commands lost" << std::endl;
+        return 1;
+    }
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// redis 不可用时暂存命令的磁盘队列
+// 命令按顺序追加到分段文件 <dir>/<name>-<序号>.spool，写满 segmentBytes 换下一个文件；回放从最老的分段顺序读取，
+// 一个分段读完即删除。总大小超过 maxBytes 时丢弃最老的分段。进程重启后从剩下的分段开头重新回放，
+// 正在回放的分段中已经发出的命令可能重复一次。只能在一个线程中使用，统计可在其他线程读取。
+//
+// 记录格式：u32 长度 | u32 校验 | i64 入队时间(epoch ms) | u32 参数个数 | (u32 长度 | 参数)...
+class RedisSpool {
+public:
+    struct Stats {
+        std::atomic<uint64_t> spooled{0};
+        std::atomic<uint64_t> replayed{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> corrupted{0};
+        std::atomic<uint64_t> depth{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<int64_t> oldestMs{0};
+    };
+
+    RedisSpool(const std::string& directory, const std::string& name, uint64_t segmentBytes, uint64_t maxBytes)
+        : directory(directory), name(name), segmentBytes(std::max<uint64_t>(segmentBytes, 4096)),
+          maxBytes(std::max(maxBytes, segmentBytes)), out(nullptr), in(nullptr), readRecords(0), hasHead(false),
+          headAt(0), nextSeq(0) {}
+
+    ~RedisSpool() {
+        closeFiles();
+    }
+
+    // 创建目录并接上次进程留下的分段
+    bool open() {
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Failed to create spool directory " << directory << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            std::cerr << "Failed to open spool directory " << directory << std::endl;
+            return false;
+        }
+        std::vector<uint64_t> found;
+        std::string prefix = name + "-";
+        while (struct dirent* entry = readdir(dir)) {
+            std::string file = entry->d_name;
+            if (file.size() > prefix.size() + 6 && file.compare(0, prefix.size(), prefix) == 0 &&
+                file.compare(file.size() - 6, 6, ".spool") == 0) {
+                found.push_back(std::strtoull(file.c_str() + prefix.size(), nullptr, 10));
+            }
+        }
+        closedir(dir);
+        std::sort(found.begin(), found.end());
+
+        for (uint64_t seq : found) {
+            Segment segment{seq, 0, 0, 0};
+            countRecords(segment);
+            segments.push_back(segment);
+            stats.depth += segment.records;
+            stats.bytes += segment.bytes;
+            nextSeq = seq + 1;
+        }
+        if (!segments.empty()) {
+            std::cout << "Redis spool " << name << ": " << stats.depth.load() << " commands left from last run" << std::endl;
+            loadHead();
+        }
+        return true;
+    }
+
+    bool empty() const { return stats.depth.load(std::memory_order_relaxed) == 0; }
+
+    bool append(const std::vector<std::string>& command, int64_t nowMs) {
+        if (out == nullptr || segments.back().bytes >= segmentBytes) {
+            if (!openSegment()) {
+                return false;
+            }
+        }
+        record.clear();
+        putInt(record, static_cast<uint64_t>(nowMs), 8);
+        putInt(record, command.size(), 4);
+        for (const auto& arg : command) {
+            putInt(record, arg.size(), 4);
+            record.append(arg);
+        }
+        std::string header;
+        putInt(header, record.size(), 4);
+        putInt(header, checksum(record), 4);
+        if (std::fwrite(header.data(), 1, header.size(), out) != header.size() ||
+            std::fwrite(record.data(), 1, record.size(), out) != record.size()) {
+            std::cerr << "Failed to write redis spool: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        uint64_t size = header.size() + record.size();
+        segments.back().bytes += size;
+        ++segments.back().records;
+        segments.back().lastAtMs = nowMs;
+        stats.bytes += size;
+        stats.spooled.fetch_add(1, std::memory_order_relaxed);
+        if (stats.depth.fetch_add(1) == 0) {
+            stats.oldestMs = nowMs;
+        }
+        enforceLimit();
+        return true;
+    }
+
+    // 把缓冲的记录写到文件，一批命令入队后调用一次
+    void flush() {
+        if (out != nullptr) {
+            std::fflush(out);
+        }
+    }
+
+    // 写到文件并落盘，之前追加的记录在断电后也还在；换段时旧分段已经落盘
+    bool sync() {
+        if (out == nullptr) {
+            return true;
+        }
+        if (std::fflush(out) != 0 || fdatasync(fileno(out)) != 0) {
+            std::cerr << "Failed to sync redis spool: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 取出最老的一条命令
+    bool pop(std::vector<std::string>& command, int64_t& spooledAtMs) {
+        if (!hasHead && !loadHead()) {
+            return false;
+        }
+        command.swap(head);
+        spooledAtMs = headAt;
+        hasHead = false;
+        stats.depth.fetch_sub(1);
+        stats.replayed.fetch_add(1, std::memory_order_relaxed);
+        if (!loadHead()) {
+            stats.oldestMs = 0;
+        }
+        return true;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Segment {
+        uint64_t seq;
+        uint64_t records;
+        uint64_t bytes;
+        // 本进程最后追加的记录的时间，重启前写的分段为0
+        int64_t lastAtMs;
+    };
+
+    std::string directory;
+    std::string name;
+    uint64_t segmentBytes;
+    uint64_t maxBytes;
+    std::deque<Segment> segments;
+    FILE* out;
+    FILE* in;
+    uint64_t readRecords;
+    bool hasHead;
+    std::vector<std::string> head;
+    int64_t headAt;
+    uint64_t nextSeq;
+    std::string record;
+    Stats stats;
+
+    std::string pathOf(uint64_t seq) const {
+        char file[32];
+        std::snprintf(file, sizeof(file), "-%010llu.spool", static_cast<unsigned long long>(seq));
+        return directory + "/" + name + file;
+    }
+
+    static void putInt(std::string& outBuffer, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            outBuffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    static uint64_t getInt(const char* data, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    static uint32_t checksum(const std::string& data) {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : data) {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    bool openSegment() {
+        if (out != nullptr) {
+            std::fflush(out);
+            fdatasync(fileno(out));
+            std::fclose(out);
+        }
+        segments.push_back(Segment{nextSeq++, 0, 0, 0});
+        out = std::fopen(pathOf(segments.back().seq).c_str(), "wb");
+        if (out == nullptr) {
+            std::cerr << "Failed to create redis spool segment: " << std::strerror(errno) << std::endl;
+            segments.pop_back();
+            return false;
+        }
+        return true;
+    }
+
+    void closeFiles() {
+        if (out != nullptr) {
+            std::fclose(out);
+            out = nullptr;
+        }
+        if (in != nullptr) {
+            std::fclose(in);
+            in = nullptr;
+        }
+    }
+
+    // 读一条完整且校验正确的记录；读到分段末尾或损坏的记录时返回false
+    bool readRecord(FILE* file, std::vector<std::string>* command, int64_t* spooledAtMs, uint64_t* size) {
+        char header[8];
+        if (std::fread(header, 1, sizeof(header), file) != sizeof(header)) {
+            return false;
+        }
+        uint64_t length = getInt(header, 4);
+        if (length < 12 || length > segmentBytes + (64u << 20)) {
+            return false;
+        }
+        record.resize(length);
+        if (std::fread(&record[0], 1, length, file) != length || checksum(record) != getInt(header + 4, 4)) {
+            return false;
+        }
+        *size = sizeof(header) + length;
+        if (command == nullptr) {
+            return true;
+        }
+        *spooledAtMs = static_cast<int64_t>(getInt(record.data(), 8));
+        uint64_t argc = getInt(record.data() + 8, 4);
+        size_t pos = 12;
+        command->clear();
+        for (uint64_t i = 0; i < argc; ++i) {
+            if (pos + 4 > record.size()) {
+                return false;
+            }
+            uint64_t argLength = getInt(record.data() + pos, 4);
+            pos += 4;
+            if (pos + argLength > record.size()) {
+                return false;
+            }
+            command->push_back(record.substr(pos, argLength));
+            pos += argLength;
+        }
+        return true;
+    }
+
+    void countRecords(Segment& segment) {
+        FILE* file = std::fopen(pathOf(segment.seq).c_str(), "rb");
+        if (file == nullptr) {
+            return;
+        }
+        uint64_t size;
+        while (readRecord(file, nullptr, nullptr, &size)) {
+            ++segment.records;
+            segment.bytes += size;
+        }
+        std::fclose(file);
+    }
+
+    // 读出下一条记录作为队首；当前分段读完后删除，换下一个分段
+    bool loadHead() {
+        while (!segments.empty()) {
+            Segment& segment = segments.front();
+            bool writing = out != nullptr && segments.size() == 1;
+            if (writing) {
+                std::fflush(out);
+            }
+            if (in == nullptr) {
+                in = std::fopen(pathOf(segment.seq).c_str(), "rb");
+                readRecords = 0;
+                if (in == nullptr) {
+                    dropFront();
+                    continue;
+                }
+            }
+            uint64_t size;
+            if (readRecords < segment.records && readRecord(in, &head, &headAt, &size)) {
+                ++readRecords;
+                hasHead = true;
+                stats.oldestMs = headAt;
+                return true;
+            }
+            if (readRecords < segment.records) {
+                // 记录损坏（例如写入时断电），跳过这个分段剩下的部分
+                stats.corrupted.fetch_add(segment.records - readRecords, std::memory_order_relaxed);
+            }
+            if (writing && readRecords >= segment.records) {
+                // 已经追上写入位置：队列为空，写完的分段删除，下一条命令写新的分段
+                std::fclose(out);
+                out = nullptr;
+            }
+            dropFront();
+        }
+        return false;
+    }
+
+    // 删除最老的分段，其中还没回放的记录不再计入深度
+    void dropFront() {
+        Segment& segment = segments.front();
+        if (in != nullptr) {
+            std::fclose(in);
+            in = nullptr;
+        }
+        if (segments.size() == 1 && out != nullptr) {
+            std::fclose(out);
+            out = nullptr;
+        }
+        uint64_t unread = segment.records - std::min(readRecords, segment.records);
+        stats.depth.fetch_sub(unread);
+        stats.bytes.fetch_sub(segment.bytes);
+        std::remove(pathOf(segment.seq).c_str());
+        segments.pop_front();
+        readRecords = 0;
+    }
+
+    // 超过总大小上限时丢弃最老的分段，保留正在写的分段；丢弃的命令可能已经被检查点确认，记录丢失的时间范围
+    void enforceLimit() {
+        while (stats.bytes.load() > maxBytes && segments.size() > 1) {
+            Segment& segment = segments.front();
+            uint64_t unread = segment.records - std::min(readRecords, segment.records) + (hasHead ? 1 : 0);
+            stats.dropped.fetch_add(unread, std::memory_order_relaxed);
+            std::cerr << "Redis spool " << name << " over max-size, dropped " << unread << " commands in "
+                      << pathOf(segment.seq) << " spooled from " << (hasHead ? std::to_string(headAt) : std::string("?"))
+                      << " to " << (segment.lastAtMs > 0 ? std::to_string(segment.lastAtMs) : std::string("?")) << " (ms)"
+                      << std::endl;
+            if (hasHead) {
+                hasHead = false;
+                stats.depth.fetch_sub(1);
+            }
+            dropFront();
+            loadHead();
+        }
+    }
+};
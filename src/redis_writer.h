@@ -0,0 +1,588 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <cpp_redis/cpp_redis>
+#include "concurrentqueue.h"
+#include "metrics.h"
+#include "redis_spool.h"
+#include "resp.h"
+
+// redis 连接和批量写参数，对应 serial_config.json 中的 redis 块
+struct RedisConfig {
+    std::string host = "127.0.0.1";
+    int port = 6379;
+    size_t batchSize = 256;
+    int flushIntervalMs = 5;
+    size_t window = 8192;
+    // 客户端：cpp_redis，或 resp（直接在socket上编码RESP，每批命令一次writev，应答增量解析，不经过future和回调）
+    std::string client = "cpp_redis";
+    // 最新值的存储方式：json 为每个设备一个JSON字符串，hash 为每个设备一个hash且只写变化的字段
+    std::string storage = "json";
+    // 历史数据：每个设备一个stream(historyPrefix + uuid)，按 MAXLEN ~ historyMaxLen 近似裁剪，0表示不写
+    size_t historyMaxLen = 0;
+    std::string historyPrefix = "history:";
+    // 时间索引：每个设备一个 zset(indexPrefix + uuid)，保留 indexRetentionMs 内的数据，0表示不写；
+    // 每写 indexTrimEvery 条裁剪一次过期数据
+    int64_t indexRetentionMs = 0;
+    std::string indexPrefix = "ts:";
+    uint32_t indexTrimEvery = 100;
+    // 断开期间的命令暂存到 spoolDir 下的分段文件，重新连上后按 replayRate 条/秒回放；spoolDir 为空时直接丢弃
+    std::string spoolDir;
+    uint64_t spoolSegmentBytes = 8ull << 20;
+    uint64_t spoolMaxBytes = 1ull << 30;
+    int replayRate = 5000;
+};
+
+using RedisCommand = std::vector<std::string>;
+
+// 异步批量写redis
+// 采集线程只把命令放进队列；写线程攒够 batchSize 条或每隔 flushIntervalMs 把队列中的命令一次性pipeline发出，
+// 不等待应答。已入队但还没收到应答的命令达到 window 条时 send 阻塞，redis变慢时内存不会无限增长。
+// 连接断开期间的命令写入磁盘暂存队列，重新连上后在实时命令的空隙中限速回放；回放时已被实时写入覆盖的
+// 最新值(SET/HSET 同一个key)跳过，避免旧值覆盖新值。
+class RedisWriter {
+public:
+    using ptr = std::shared_ptr<RedisWriter>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint64_t> commands{0};
+        std::atomic<uint64_t> replies{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> backpressureWaits{0};
+        std::atomic<uint64_t> superseded{0};
+        // 实时命令中已经有结果的条数（收到应答、写入暂存或丢弃），命令按顺序发出，
+        // settled 追上某时刻的 commands 即表示该时刻之前 send 的命令都已处理完
+        std::atomic<uint64_t> settled{0};
+        // settled 中没有写入成功的实时命令：错误应答，或者没有暂存而丢弃
+        std::atomic<uint64_t> failed{0};
+        std::atomic<uint64_t> replayPerSec{0};
+        Histogram batchSize;
+        Histogram flushLatencyUs;
+    };
+
+    // name 用作暂存文件名，同一目录下每条连接需要不同
+    explicit RedisWriter(const RedisConfig& config, const std::string& name = "redis")
+        : config(config), useResp(config.client == "resp"), respConnected(false), replayTokens(0), replayedInWindow(0),
+          running(false), queued(0), inFlight(0), waiters(0), epoch(0) {
+        if (this->config.batchSize == 0) {
+            this->config.batchSize = 1;
+        }
+        if (this->config.window < this->config.batchSize) {
+            this->config.window = this->config.batchSize;
+        }
+        if (!this->config.spoolDir.empty()) {
+            spool.reset(new RedisSpool(this->config.spoolDir, name, this->config.spoolSegmentBytes, this->config.spoolMaxBytes));
+        }
+    }
+
+    ~RedisWriter() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        if (spool && !spool->open()) {
+            spool.reset();
+        }
+        connect();
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    // 停止前把队列中剩下的命令发出
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake.notify_all();
+            windowFree.notify_all();
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // 检查点调用：等写线程把暂存文件 fdatasync 一次，调用前已计入 settled 的暂存命令在断电后也还在。
+    // 没有配置暂存目录时直接返回true；落盘失败或超时返回false
+    bool syncSpool(int timeoutMs) {
+        if (config.spoolDir.empty()) {
+            return true;
+        }
+        uint64_t ticket = syncRequests.fetch_add(1) + 1;
+        auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (spoolSynced.load() < ticket) {
+            if (Clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // 线程安全；在途窗口满时阻塞到有应答返回
+    void send(RedisCommand command) {
+        if (!reserveSlot()) {
+            stats.backpressureWaits.fetch_add(1, std::memory_order_relaxed);
+            std::unique_lock<std::mutex> lock(mutex);
+            ++waiters;
+            bool reserved = false;
+            windowFree.wait(lock, [this, &reserved]{
+                reserved = reserveSlot();
+                return reserved || !running.load();
+            });
+            --waiters;
+            // 已停止时不再限制窗口，命令留给 stop 前的最后一轮发送
+            if (!reserved) {
+                inFlight.fetch_add(1);
+            }
+        }
+        stats.commands.fetch_add(1, std::memory_order_relaxed);
+        queue.enqueue(std::move(command));
+        if (queued.fetch_add(1, std::memory_order_acq_rel) + 1 == config.batchSize) {
+            std::lock_guard<std::mutex> lock(mutex);
+            wake.notify_one();
+        }
+    }
+
+    size_t pending() const { return inFlight.load(std::memory_order_relaxed); }
+    const RedisConfig& getConfig() const { return config; }
+
+    // 每次(重新)连上redis加1，之前缓存的"已写入"状态在连接变化后不再可信
+    uint64_t connectionEpoch() const { return epoch.load(std::memory_order_acquire); }
+    bool connected() { return useResp ? respConnected.load() : client.is_connected(); }
+    const Stats& getStats() const { return stats; }
+    // 未配置暂存目录时为空
+    const RedisSpool* getSpool() const { return spool.get(); }
+
+private:
+    // 一批命令共享的状态，最后一条应答返回时记录整批的延迟
+    // commands 保留到收到应答为止，连接断开时没有应答的命令写入暂存队列
+    struct PendingBatch {
+        std::atomic<size_t> remaining;
+        Clock::time_point sentAt;
+        // 回放的批次不计入 settled
+        bool live;
+        std::vector<RedisCommand> commands;
+    };
+
+    // 应答按顺序返回，commands 中最后 remaining 条还没有应答
+    struct RespBatch {
+        size_t remaining;
+        Clock::time_point sentAt;
+        bool live;
+        std::vector<RedisCommand> commands;
+    };
+
+    // cpp_redis 回调线程中收到连接失败应答的命令，由写线程写入暂存队列
+    struct LostCommand {
+        RedisCommand command;
+        bool live;
+    };
+
+    enum { kReconnectIntervalMs = 1000, kSpareBatches = 16 };
+
+    RedisConfig config;
+    bool useResp;
+    cpp_redis::client client;
+    Clock::time_point lastConnectAttempt;
+
+    // resp 客户端只在写线程中使用；respBatches 按顺序记录已发出的每批命令和还没收到的应答数，用于统计整批延迟和断开时暂存
+    resp::Connection respConnection;
+    std::deque<RespBatch> respBatches;
+    std::vector<std::vector<RedisCommand>> spareCommands;
+    std::atomic<bool> respConnected;
+
+    // 磁盘暂存队列只在写线程中使用；liveKeys 为暂存队列非空期间实时写过的最新值key
+    std::unique_ptr<RedisSpool> spool;
+    std::unordered_set<std::string> liveKeys;
+    std::vector<RedisCommand> replayBatch;
+    std::mutex lostMutex;
+    std::vector<LostCommand> lostCommands;
+    std::vector<LostCommand> lostTaken;
+    double replayTokens;
+    Clock::time_point lastReplayRefill;
+    uint64_t replayedInWindow;
+    Clock::time_point replayWindowStart;
+
+    moodycamel::ConcurrentQueue<RedisCommand> queue;
+    std::atomic<bool> running;
+    std::atomic<size_t> queued;
+    std::atomic<size_t> inFlight;
+    std::atomic<int> waiters;
+    std::atomic<uint64_t> epoch;
+    // syncSpool 的请求序号和写线程已落盘的序号
+    std::atomic<uint64_t> syncRequests{0};
+    std::atomic<uint64_t> spoolSynced{0};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable windowFree;
+    std::thread worker;
+    Stats stats;
+
+    void connect() {
+        if (useResp) {
+            connectResp();
+            return;
+        }
+        lastConnectAttempt = Clock::now();
+        try {
+            client.connect(config.host, static_cast<size_t>(config.port),
+                [this](const std::string& host, size_t port, cpp_redis::client::connect_state status) {
+                    if (status == cpp_redis::client::connect_state::ok) {
+                        epoch.fetch_add(1, std::memory_order_acq_rel);
+                    } else if (status == cpp_redis::client::connect_state::dropped) {
+                        std::cerr << "Redis connection to " << host << ":" << port << " dropped" << std::endl;
+                    }
+                }, 0, -1, kReconnectIntervalMs);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to connect to redis " << config.host << ":" << config.port << ": " << e.what() << std::endl;
+        }
+    }
+
+    void run() {
+        std::vector<RedisCommand> batch(config.batchSize);
+        lastReplayRefill = replayWindowStart = Clock::now();
+        while (running.load()) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(config.flushIntervalMs), [this]{
+                    return queued.load(std::memory_order_acquire) >= config.batchSize || !running.load();
+                });
+            }
+            flush(batch);
+            replay();
+            syncRequested();
+        }
+        flush(batch);
+        spoolLost();
+        if (spool) {
+            spool->sync();
+        }
+        // 写线程退出后不会再有命令写入暂存
+        spoolSynced.store(std::numeric_limits<uint64_t>::max());
+    }
+
+    // 暂存文件只在检查点请求时落盘，平时每批只 fflush，不为每条断开时丢失的命令做一次 fdatasync
+    void syncRequested() {
+        uint64_t requested = syncRequests.load();
+        if (requested == spoolSynced.load()) {
+            return;
+        }
+        if (!spool || spool->sync()) {
+            spoolSynced.store(requested);
+        }
+    }
+
+    void flush(std::vector<RedisCommand>& batch) {
+        spoolLost();
+        readRespReplies(0);
+        size_t n;
+        while ((n = queue.try_dequeue_bulk(batch.begin(), batch.size())) > 0) {
+            queued.fetch_sub(n, std::memory_order_acq_rel);
+            if (!ensureConnected()) {
+                spoolOrDrop(batch.data(), n);
+                release(n);
+                continue;
+            }
+            if (spool && !spool->empty()) {
+                for (size_t i = 0; i < n; ++i) {
+                    if (const std::string* key = latestValueKey(batch[i])) {
+                        liveKeys.insert(*key);
+                    }
+                }
+            }
+            writeBatch(batch, n);
+        }
+        // 等待一小段时间收应答，让在途窗口尽快释放
+        readRespReplies(1);
+    }
+
+    bool ensureConnected() {
+        if (useResp) {
+            if (!respConnection.connected() &&
+                Clock::now() - lastConnectAttempt > std::chrono::milliseconds(kReconnectIntervalMs)) {
+                connectResp();
+            }
+            return respConnection.connected();
+        }
+        if (!client.is_connected()) {
+            // 首次连接失败时客户端不会自动重连，这里按间隔重试
+            if (!client.is_reconnecting() && Clock::now() - lastConnectAttempt > std::chrono::milliseconds(kReconnectIntervalMs)) {
+                connect();
+            }
+        }
+        return client.is_connected();
+    }
+
+    // 把已确认连接可用的一批命令pipeline写出
+    void writeBatch(std::vector<RedisCommand>& batch, size_t n, bool live = true) {
+        if (useResp) {
+            std::vector<RedisCommand> commands;
+            if (!spareCommands.empty()) {
+                commands.swap(spareCommands.back());
+                spareCommands.pop_back();
+            }
+            commands.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                respConnection.append(batch[i]);
+                commands[i].swap(batch[i]);
+            }
+            respBatches.push_back(RespBatch{n, Clock::now(), live, std::move(commands)});
+            respConnection.flush([this](bool error) {
+                onRespReply(error);
+            });
+            checkRespConnection();
+        } else {
+            std::shared_ptr<PendingBatch> pendingBatch = std::make_shared<PendingBatch>();
+            pendingBatch->remaining = n;
+            pendingBatch->sentAt = Clock::now();
+            pendingBatch->live = live;
+            pendingBatch->commands.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                client.send(batch[i], [this, pendingBatch, i](cpp_redis::reply& reply) {
+                    onReply(reply, *pendingBatch, i);
+                });
+                pendingBatch->commands[i].swap(batch[i]);
+            }
+            try {
+                // 连接断开时客户端会以错误应答回调本批命令
+                client.commit();
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to write to redis: " << e.what() << std::endl;
+            }
+        }
+        stats.batches.fetch_add(1, std::memory_order_relaxed);
+        stats.batchSize.record(n);
+    }
+
+    // 回放的命令（live 为false）重新暂存时不计入 settled。
+    // 暂存的命令写到文件后计入 settled，检查点再通过 syncSpool 落盘；丢弃的实时命令计入 failed。
+    // 暂存超过 max-size 时丢弃的最老命令可能早已被确认，也计入 failed，使下一次检查点失败
+    void spoolOrDrop(const RedisCommand* commands, size_t n, bool live = true) {
+        size_t dropped = n;
+        if (spool) {
+            int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            uint64_t overflow = spool->getStats().dropped.load();
+            dropped = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (!spool->append(commands[i], nowMs)) {
+                    ++dropped;
+                }
+            }
+            stats.dropped.fetch_add(dropped, std::memory_order_relaxed);
+            stats.failed.fetch_add(spool->getStats().dropped.load() - overflow, std::memory_order_relaxed);
+            spool->flush();
+        } else {
+            stats.dropped.fetch_add(n, std::memory_order_relaxed);
+        }
+        if (live) {
+            stats.failed.fetch_add(dropped, std::memory_order_relaxed);
+            stats.settled.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    // 覆盖写的最新值命令以key判断是否已被实时写入取代；集群快照(EVAL)以版本号key代表整个快照
+    static const std::string* latestValueKey(const RedisCommand& command) {
+        if (command.size() >= 2 && (command[0] == "SET" || command[0] == "HSET")) {
+            return &command[1];
+        }
+        if (command.size() >= 4 && command[0] == "EVAL") {
+            return &command[3];
+        }
+        return nullptr;
+    }
+
+    // 回放暂存的命令：令牌桶限制为 replayRate 条/秒，并且只在实时队列没有积压、在途窗口不到一半时回放，
+    // 实时数据总是优先
+    void replay() {
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastReplayRefill).count();
+        lastReplayRefill = now;
+        replayTokens = std::min(replayTokens + elapsed * config.replayRate, std::max(config.replayRate / 10.0, 1.0));
+        if (now - replayWindowStart >= std::chrono::seconds(1)) {
+            stats.replayPerSec = static_cast<uint64_t>(replayedInWindow /
+                std::chrono::duration<double>(now - replayWindowStart).count());
+            replayedInWindow = 0;
+            replayWindowStart = now;
+        }
+
+        if (!spool || spool->empty()) {
+            liveKeys.clear();
+            return;
+        }
+        if (queued.load(std::memory_order_acquire) >= config.batchSize ||
+            inFlight.load(std::memory_order_acquire) >= config.window / 2 || !ensureConnected()) {
+            return;
+        }
+
+        size_t limit = std::min(static_cast<size_t>(replayTokens), config.batchSize);
+        replayBatch.resize(config.batchSize);
+        size_t n = 0;
+        int64_t spooledAtMs;
+        for (size_t popped = 0; popped < limit && spool->pop(replayBatch[n], spooledAtMs); ++popped) {
+            replayTokens -= 1;
+            const std::string* key = latestValueKey(replayBatch[n]);
+            if (key != nullptr && liveKeys.count(*key) > 0) {
+                stats.superseded.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            ++n;
+        }
+        if (n == 0) {
+            return;
+        }
+        // 暂存的命令在 send 时已经计入 commands，这里只重新占用在途窗口
+        replayedInWindow += n;
+        inFlight.fetch_add(n, std::memory_order_acq_rel);
+        writeBatch(replayBatch, n, false);
+    }
+
+    void connectResp() {
+        lastConnectAttempt = Clock::now();
+        if (respConnection.connect(config.host, config.port)) {
+            respConnected = true;
+            epoch.fetch_add(1, std::memory_order_acq_rel);
+        } else {
+            std::cerr << "Failed to connect to redis " << config.host << ":" << config.port << std::endl;
+        }
+    }
+
+    void readRespReplies(int timeoutMs) {
+        if (!useResp) {
+            return;
+        }
+        respConnection.readReplies([this](bool error) {
+            onRespReply(error);
+        }, timeoutMs);
+        checkRespConnection();
+    }
+
+    void onRespReply(bool error) {
+        if (error) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        stats.replies.fetch_add(1, std::memory_order_relaxed);
+        if (!respBatches.empty()) {
+            RespBatch& front = respBatches.front();
+            if (front.live) {
+                if (error) {
+                    stats.failed.fetch_add(1, std::memory_order_relaxed);
+                }
+                stats.settled.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (--front.remaining == 0) {
+                stats.flushLatencyUs.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - front.sentAt).count()));
+                if (spareCommands.size() < kSpareBatches) {
+                    spareCommands.push_back(std::move(front.commands));
+                }
+                respBatches.pop_front();
+            }
+        }
+        release(1);
+    }
+
+    // 连接断开时已发出（或还在发送缓冲区中）未应答的命令按原顺序写入暂存队列，重新连上后回放；
+    // 其中一部分可能已经被redis执行，回放时会重复写入
+    void checkRespConnection() {
+        if (respConnection.connected() || !respConnected.load()) {
+            return;
+        }
+        respConnected = false;
+        size_t lost = 0;
+        for (auto& pendingBatch : respBatches) {
+            size_t first = pendingBatch.commands.size() - pendingBatch.remaining;
+            spoolOrDrop(pendingBatch.commands.data() + first, pendingBatch.remaining, pendingBatch.live);
+            lost += pendingBatch.remaining;
+        }
+        respBatches.clear();
+        release(lost);
+    }
+
+    // cpp_redis 在自动重连成功后会自己重发未应答的命令；提交失败或放弃重连时以 "network failure" 错误应答回调这些命令
+    static bool networkFailure(const cpp_redis::reply& reply) {
+        return reply.is_error() && reply.as_string() == "network failure";
+    }
+
+    // 把回调线程交过来的未应答命令写入暂存队列，只在写线程中调用
+    void spoolLost() {
+        {
+            std::lock_guard<std::mutex> lock(lostMutex);
+            if (lostCommands.empty()) {
+                return;
+            }
+            lostTaken.swap(lostCommands);
+        }
+        for (auto& lost : lostTaken) {
+            spoolOrDrop(&lost.command, 1, lost.live);
+        }
+        release(lostTaken.size());
+        lostTaken.clear();
+    }
+
+    void onReply(cpp_redis::reply& reply, PendingBatch& pendingBatch, size_t index) {
+        if (networkFailure(reply)) {
+            pendingBatch.remaining.fetch_sub(1, std::memory_order_acq_rel);
+            std::lock_guard<std::mutex> lock(lostMutex);
+            lostCommands.push_back(LostCommand{std::move(pendingBatch.commands[index]), pendingBatch.live});
+            return;
+        }
+        if (reply.is_error()) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        stats.replies.fetch_add(1, std::memory_order_relaxed);
+        if (pendingBatch.live) {
+            if (reply.is_error()) {
+                stats.failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            stats.settled.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (pendingBatch.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            stats.flushLatencyUs.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pendingBatch.sentAt).count()));
+        }
+        release(1);
+    }
+
+    // 在途窗口未满时占用一个位置；检查和加1是一次 CAS，多个线程同时 send 也不会超出窗口
+    bool reserveSlot() {
+        size_t current = inFlight.load();
+        while (current < config.window) {
+            if (inFlight.compare_exchange_weak(current, current + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 与 send 中的 ++waiters、reserveSlot 都用 seq_cst，保证等待者要么看到释放出的窗口，要么被唤醒
+    void release(size_t n) {
+        inFlight.fetch_sub(n);
+        if (waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            windowFree.notify_all();
+        }
+    }
+};
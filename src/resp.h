@@ -0,0 +1,418 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// RESP 编码：直接追加到调用者复用的缓冲区，clear() 后容量保留，稳定运行时不再分配内存
+namespace resp {
+
+// 把整数写到 end 之前的位置，返回起始位置；调用者至少预留20字节
+inline char* formatInteger(char* end, int64_t value) {
+    char* p = end;
+    uint64_t v = value < 0 ? static_cast<uint64_t>(-(value + 1)) + 1 : static_cast<uint64_t>(value);
+    do {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    return p;
+}
+
+inline void appendInteger(std::string& out, int64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = formatInteger(end, value);
+    out.append(begin, static_cast<size_t>(end - begin));
+}
+
+inline void appendArrayHeader(std::string& out, size_t count) {
+    out.push_back('*');
+    appendInteger(out, static_cast<int64_t>(count));
+    out.append("\r\n", 2);
+}
+
+inline void appendBulk(std::string& out, const char* data, size_t size) {
+    out.push_back('$');
+    appendInteger(out, static_cast<int64_t>(size));
+    out.append("\r\n", 2);
+    out.append(data, size);
+    out.append("\r\n", 2);
+}
+
+inline void appendBulk(std::string& out, const std::string& value) {
+    appendBulk(out, value.data(), value.size());
+}
+
+// 整数按十进制字符串作为一个参数，可带固定前缀（如 "device:" + 编号）
+inline void appendBulk(std::string& out, int64_t value, const char* prefix = "", size_t prefixSize = 0) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = formatInteger(end, value);
+    size_t size = static_cast<size_t>(end - begin);
+    out.push_back('$');
+    appendInteger(out, static_cast<int64_t>(prefixSize + size));
+    out.append("\r\n", 2);
+    out.append(prefix, prefixSize);
+    out.append(begin, size);
+    out.append("\r\n", 2);
+}
+
+inline void appendCommand(std::string& out, const std::vector<std::string>& args) {
+    appendArrayHeader(out, args.size());
+    for (const auto& arg : args) {
+        appendBulk(out, arg);
+    }
+}
+
+// 增量解析应答：只判断每个顶层应答是否完整以及是否为错误，不拷贝内容，不分配内存
+class ReplyParser {
+public:
+    // 解析 data 中所有完整的顶层应答，每个调用一次 onReply(bool error)，返回消费的字节数；
+    // 剩下的不完整应答留给调用者在收到更多数据后从头再解析。格式错误时返回 npos
+    template <class Handler>
+    size_t parse(const char* data, size_t size, Handler&& onReply) {
+        size_t consumed = 0;
+        while (consumed < size) {
+            size_t pos = consumed;
+            bool error = false;
+            Result result = parseValue(data, size, pos, error, 0);
+            if (result == Incomplete) {
+                break;
+            }
+            if (result == Invalid) {
+                return npos;
+            }
+            consumed = pos;
+            onReply(error);
+        }
+        return consumed;
+    }
+
+    enum : size_t { npos = static_cast<size_t>(-1) };
+
+private:
+    enum Result { Complete, Incomplete, Invalid };
+    enum { kMaxDepth = 8 };
+
+    // 找到 pos 开始的一行，lineEnd 指向 \r
+    static bool findLine(const char* data, size_t size, size_t pos, size_t& lineEnd) {
+        const void* cr = std::memchr(data + pos, '\r', size - pos);
+        if (cr == nullptr) {
+            return false;
+        }
+        lineEnd = static_cast<size_t>(static_cast<const char*>(cr) - data);
+        return lineEnd + 1 < size;
+    }
+
+    static bool parseLength(const char* begin, const char* end, int64_t& value) {
+        bool negative = begin < end && *begin == '-';
+        if (negative) {
+            ++begin;
+        }
+        if (begin == end) {
+            return false;
+        }
+        value = 0;
+        for (; begin < end; ++begin) {
+            if (*begin < '0' || *begin > '9') {
+                return false;
+            }
+            value = value * 10 + (*begin - '0');
+        }
+        if (negative) {
+            value = -value;
+        }
+        return true;
+    }
+
+    static Result parseValue(const char* data, size_t size, size_t& pos, bool& error, int depth) {
+        if (pos >= size) {
+            return Incomplete;
+        }
+        if (depth > kMaxDepth) {
+            return Invalid;
+        }
+        char type = data[pos];
+        size_t lineEnd;
+        if (!findLine(data, size, pos + 1, lineEnd)) {
+            return Incomplete;
+        }
+        if (data[lineEnd + 1] != '\n') {
+            return Invalid;
+        }
+        size_t next = lineEnd + 2;
+
+        switch (type) {
+            case '-':
+                if (depth == 0) {
+                    error = true;
+                }
+                pos = next;
+                return Complete;
+            case '+':
+            case ':':
+                pos = next;
+                return Complete;
+            case '$': {
+                int64_t length;
+                if (!parseLength(data + pos + 1, data + lineEnd, length)) {
+                    return Invalid;
+                }
+                if (length < 0) {
+                    pos = next;
+                    return Complete;
+                }
+                if (next + static_cast<size_t>(length) + 2 > size) {
+                    return Incomplete;
+                }
+                pos = next + static_cast<size_t>(length) + 2;
+                return Complete;
+            }
+            case '*': {
+                int64_t count;
+                if (!parseLength(data + pos + 1, data + lineEnd, count)) {
+                    return Invalid;
+                }
+                pos = next;
+                for (int64_t i = 0; i < count; ++i) {
+                    bool nestedError = false;
+                    Result result = parseValue(data, size, pos, nestedError, depth + 1);
+                    if (result != Complete) {
+                        return result;
+                    }
+                }
+                return Complete;
+            }
+            default:
+                return Invalid;
+        }
+    }
+};
+
+// 直接基于socket的redis连接
+// 命令编码进 staging 缓冲区，flush 时与上次没写完的 sending 缓冲区一起用 writev 写出，两个缓冲区交替复用；
+// 应答读入固定大小的缓冲区后增量解析。只能在一个线程中使用。
+class Connection {
+public:
+    Connection() : fd(-1), sendOffset(0), inSize(0), pendingReplies(0) {}
+
+    ~Connection() {
+        close();
+    }
+
+    // 非阻塞连接，每个地址最多等待 timeoutMs，redis不可达时不会把写线程卡在内核的SYN重试上
+    bool connect(const std::string& host, int port, int timeoutMs = 1000) {
+        close();
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            std::cerr << "Failed to resolve redis host " << host << std::endl;
+            return false;
+        }
+        for (struct addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || (errno == EINPROGRESS && waitConnected(timeoutMs))) {
+                break;
+            }
+            ::close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(result);
+        if (fd < 0) {
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        sending.clear();
+        staging.clear();
+        sendOffset = 0;
+        inSize = 0;
+        pendingReplies = 0;
+    }
+
+    bool connected() const { return fd >= 0; }
+
+    // 还没收到应答的命令数
+    size_t pending() const { return pendingReplies; }
+
+    void append(const std::vector<std::string>& command) {
+        appendCommand(staging, command);
+        ++pendingReplies;
+    }
+
+    // 编码后的原始命令，count 为其中的命令数
+    std::string& buffer() { return staging; }
+    void appended(size_t count) { pendingReplies += count; }
+
+    // 写出缓冲区中的全部命令，等待可写时顺带读取应答；出错或超时返回false并关闭连接
+    template <class Handler>
+    bool flush(Handler&& onReply, int timeoutMs = 1000) {
+        while (fd >= 0 && (sendOffset < sending.size() || !staging.empty())) {
+            struct iovec iov[2];
+            int count = 0;
+            if (sendOffset < sending.size()) {
+                iov[count].iov_base = &sending[sendOffset];
+                iov[count].iov_len = sending.size() - sendOffset;
+                ++count;
+            }
+            if (!staging.empty()) {
+                iov[count].iov_base = &staging[0];
+                iov[count].iov_len = staging.size();
+                ++count;
+            }
+            ssize_t n = ::writev(fd, iov, count);
+            if (n > 0) {
+                advance(static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Failed to write to redis: " << std::strerror(errno) << std::endl;
+                close();
+                return false;
+            }
+            if (!wait(POLLOUT, timeoutMs, onReply)) {
+                return false;
+            }
+        }
+        return fd >= 0;
+    }
+
+    // 读取已经到达的应答，timeoutMs 为0时不等待
+    template <class Handler>
+    bool readReplies(Handler&& onReply, int timeoutMs = 0) {
+        if (fd < 0) {
+            return false;
+        }
+        if (timeoutMs > 0 && pendingReplies > 0) {
+            return wait(POLLIN, timeoutMs, onReply);
+        }
+        return receive(onReply);
+    }
+
+private:
+    enum { kInputSize = 64 * 1024 };
+
+    int fd;
+    std::string sending;
+    size_t sendOffset;
+    std::string staging;
+    char input[kInputSize];
+    size_t inSize;
+    size_t pendingReplies;
+    ReplyParser parser;
+
+    // 等待正在进行的连接完成，超时或失败返回false
+    bool waitConnected(int timeoutMs) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        int ready;
+        do {
+            ready = ::poll(&pfd, 1, timeoutMs);
+        } while (ready < 0 && errno == EINTR);
+        if (ready == 0) {
+            std::cerr << "Timed out connecting to redis" << std::endl;
+            return false;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (ready < 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            return false;
+        }
+        return true;
+    }
+
+    void advance(size_t n) {
+        size_t fromSending = std::min(n, sending.size() - sendOffset);
+        sendOffset += fromSending;
+        n -= fromSending;
+        if (sendOffset == sending.size()) {
+            // sending 写完后与 staging 交换，staging 中已写出的部分留在新的 sending 里
+            sending.swap(staging);
+            staging.clear();
+            sendOffset = n;
+            if (sendOffset == sending.size()) {
+                sending.clear();
+                sendOffset = 0;
+            }
+        }
+    }
+
+    template <class Handler>
+    bool wait(short events, int timeoutMs, Handler& onReply) {
+        struct pollfd pfd = {fd, static_cast<short>(events | POLLIN), 0};
+        int ready = ::poll(&pfd, 1, timeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            close();
+            return false;
+        }
+        if (ready == 0 && events == POLLOUT) {
+            std::cerr << "Timed out writing to redis" << std::endl;
+            close();
+            return false;
+        }
+        if (ready > 0 && (pfd.revents & (POLLIN | POLLERR | POLLHUP))) {
+            return receive(onReply);
+        }
+        return true;
+    }
+
+    template <class Handler>
+    bool receive(Handler& onReply) {
+        while (fd >= 0) {
+            ssize_t n = ::read(fd, input + inSize, kInputSize - inSize);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                std::cerr << "Redis connection closed" << std::endl;
+                close();
+                return false;
+            }
+            if (n < 0) {
+                return true;
+            }
+            inSize += static_cast<size_t>(n);
+            size_t consumed = parser.parse(input, inSize, [this, &onReply](bool error) {
+                if (pendingReplies > 0) {
+                    --pendingReplies;
+                }
+                onReply(error);
+            });
+            if (consumed == ReplyParser::npos || (consumed == 0 && inSize == kInputSize)) {
+                std::cerr << "Invalid reply from redis" << std::endl;
+                close();
+                return false;
+            }
+            std::memmove(input, input + consumed, inSize - consumed);
+            inSize -= consumed;
+        }
+        return false;
+    }
+};
+
+}  // namespace resp
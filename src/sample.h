@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// 一个设备一次采集得到的数据，定长、不分配内存
+// values[i] 对应设备 fields[i]
+struct Sample {
+    enum { kMaxValues = 16 };
+
+    uint32_t device = 0;
+    uint32_t count = 0;
+    double values[kMaxValues];
+    // 串口I/O完成的时刻（单调时钟），写出时再换算成墙上时间
+    std::chrono::steady_clock::time_point capturedAt;
+};
+
+// 一次采样的文本形式，交给缓存、redis和文件：name(i) 对应 values[i]，前 count 项有效，
+// 另外带上采集时间（timestamp 为本地时间，capturedAt 为毫秒时间戳的十进制文本）。
+// 字段名指向设备配置中的字段表，values 由采集线程循环复用，稳定运行时不再分配内存。
+struct SampleText {
+    const std::vector<std::string>* names = nullptr;
+    std::vector<std::string> values;
+    size_t count = 0;
+    std::string timestamp;
+    int64_t capturedAtMs = 0;
+    std::string capturedAt;
+
+    const std::string& name(size_t i) const { return (*names)[i]; }
+
+    // 和 std::to_string(double) 相同的格式，写入复用的字符串
+    static void format(std::string& out, double value) {
+        char buffer[64];
+        int n = std::snprintf(buffer, sizeof(buffer), "%f", value);
+        if (n < 0 || n >= static_cast<int>(sizeof(buffer))) {
+            out = std::to_string(value);
+            return;
+        }
+        out.assign(buffer, static_cast<size_t>(n));
+    }
+};
+
+// 追加带引号的JSON字符串
+inline void appendJsonString(std::string& out, const std::string& text) {
+    static const char* hex = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (u < 0x20) {
+            out.append("\\u00", 4);
+            out.push_back(hex[u >> 4]);
+            out.push_back(hex[u & 0xf]);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+// {"字段":"值",...,"timestamp":"...","captured-at":毫秒}，和原来 Json::Value 写出的内容相同
+inline void appendSampleJson(std::string& out, const SampleText& sample) {
+    out.push_back('{');
+    for (size_t i = 0; i < sample.count; ++i) {
+        appendJsonString(out, sample.name(i));
+        out.push_back(':');
+        appendJsonString(out, sample.values[i]);
+        out.push_back(',');
+    }
+    out.append("\"timestamp\":", 12);
+    appendJsonString(out, sample.timestamp);
+    out.append(",\"captured-at\":", 15);
+    out.append(sample.capturedAt);
+    out.push_back('}');
+}
@@ -0,0 +1,529 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "metrics.h"
+
+// 采集数据的预写日志
+// 每个通道一个预分配的定长文件，mmap 后作为环形缓冲区使用：采集线程先把采样 memcpy 进日志，再更新缓存、写redis和文件，
+// 写入不经过系统调用。检查点线程定期 msync，并在确认此前分发的数据在redis上都有了结果后推进确认位置；
+// 进程重启时回放确认位置之后的记录（至少一次，回放的记录可能已经写过一部分）。
+//
+// 文件头（4096字节）中两个槽位交替写入，读取时取校验正确且写入代数较大的一个（覆盖时确认序号不变、位置会变）：
+//   char[4] "MJNL" | u32 版本 | u64 数据区大小 | u64 已确认序号 | u64 第一条未确认记录在数据区的位置 | u64 代数 | u32 校验
+// 数据区中的记录按8字节对齐：
+//   u32 负载长度 | u32 校验 | u64 序号 | u16 uuid长度 | uuid | i64 采集时间(ms) | u16 字段数 | (u16 长度 | 字段 | u16 长度 | 值)...
+// 数据区末尾放不下一条记录时写 u32 0xffffffff 回到开头。日志写满时覆盖最老的未确认记录，计入 overruns。
+class SampleJournal {
+public:
+    using ptr = std::shared_ptr<SampleJournal>;
+
+    struct Entry {
+        uint64_t seq;
+        std::string uuid;
+        int64_t capturedAtMs;
+        std::vector<std::string> names;
+        std::vector<std::string> values;
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> appended{0};
+        std::atomic<uint64_t> overruns{0};
+        std::atomic<uint64_t> recovered{0};
+        std::atomic<uint64_t> usedBytes{0};
+        std::atomic<uint64_t> ackedSeq{0};
+        std::atomic<uint64_t> lastSeq{0};
+        std::atomic<uint64_t> syncs{0};
+        Histogram syncUs;
+    };
+
+    SampleJournal(const std::string& path, uint64_t capacity)
+        : path(path), capacity(std::max<uint64_t>(capacity / 8 * 8, 4096)), fd(-1), base(nullptr), data(nullptr),
+          writePos(0), ackPos(0), ackSeq(0), nextSeq(1), used(0), headerWrites(0), dispatched(0) {}
+
+    ~SampleJournal() {
+        if (base != nullptr) {
+            ::msync(base, kHeaderBytes + capacity, MS_SYNC);
+            ::munmap(base, kHeaderBytes + capacity);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // 打开或创建日志文件，已有文件沿用其中的数据区大小；找到确认位置之后连续有效的记录
+    bool open() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open journal " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        Header header;
+        bool existing = static_cast<uint64_t>(st.st_size) > kHeaderBytes && readHeader(header);
+        if (existing && header.capacity + kHeaderBytes <= static_cast<uint64_t>(st.st_size)) {
+            capacity = header.capacity;
+        } else {
+            existing = false;
+            // 预先分配磁盘空间，写满时不会因为磁盘满而在 mmap 写入时收到 SIGBUS
+            int error = ::posix_fallocate(fd, 0, static_cast<off_t>(kHeaderBytes + capacity));
+            if (error != 0) {
+                std::cerr << "Failed to allocate journal " << path << ": " << std::strerror(error) << std::endl;
+                return false;
+            }
+        }
+        void* mapped = ::mmap(nullptr, kHeaderBytes + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            std::cerr << "Failed to map journal " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        base = static_cast<char*>(mapped);
+        data = base + kHeaderBytes;
+        if (existing) {
+            headerWrites = header.generation + 1;
+            ackSeq = header.ackSeq;
+            ackPos = header.ackOffset < capacity ? header.ackOffset / 8 * 8 : 0;
+        }
+        scan(nullptr);
+        writeHeader();
+        stats.ackedSeq = ackSeq;
+        stats.lastSeq = nextSeq - 1;
+        stats.usedBytes = used;
+        return true;
+    }
+
+    // 写入新记录前调用：按顺序回调确认位置之后的记录，返回条数
+    size_t recover(const std::function<void(const Entry&)>& callback) {
+        size_t count = scan(&callback);
+        stats.recovered.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    // 只由一个线程（通道的采集线程）调用，names[i] 对应 values[i]，取前 count 项；
+    // 返回记录序号，记录比整个数据区还大时返回0
+    uint64_t append(const std::string& uuid, int64_t capturedAtMs, const std::vector<std::string>& names,
+                    const std::vector<std::string>& values, size_t count) {
+        uint64_t payload = 2 + uuid.size() + 8 + 2;
+        for (size_t i = 0; i < count; ++i) {
+            payload += 4 + names[i].size() + values[i].size();
+        }
+        uint64_t size = recordBytes(payload);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size > capacity) {
+            return 0;
+        }
+        uint64_t padding = capacity - writePos < size ? capacity - writePos : 0;
+        while (used > 0 && used + padding + size > capacity) {
+            dropOldest();
+        }
+        if (padding > 0) {
+            if (padding >= 4) {
+                putValue<uint32_t>(data + writePos, kWrapMarker);
+            }
+            used += padding;
+            writePos = 0;
+        }
+
+        char* record = data + writePos;
+        char* p = record + kRecordHeader;
+        p = putString(p, uuid.data(), uuid.size());
+        p = putValue<int64_t>(p, capturedAtMs);
+        p = putValue<uint16_t>(p, static_cast<uint16_t>(count));
+        for (size_t i = 0; i < count; ++i) {
+            p = putString(p, names[i].data(), names[i].size());
+            p = putString(p, values[i].data(), values[i].size());
+        }
+        uint64_t seq = nextSeq++;
+        putValue<uint64_t>(record + 8, seq);
+        putValue<uint32_t>(record + 4, checksum(record + 8, 8 + payload));
+        // 长度最后写，崩溃时写了一半的记录校验不通过
+        putValue<uint32_t>(record, static_cast<uint32_t>(payload));
+
+        // 记录正好写到数据区末尾时下一条从头开始
+        writePos = (writePos + size) % capacity;
+        used += size;
+        stats.appended.fetch_add(1, std::memory_order_relaxed);
+        stats.lastSeq.store(seq, std::memory_order_relaxed);
+        stats.usedBytes.store(used, std::memory_order_relaxed);
+        return seq;
+    }
+
+    // 采集线程分发完一条记录（已交给redis连接）后调用
+    void markDispatched(uint64_t seq) {
+        dispatched.store(seq, std::memory_order_release);
+    }
+
+    uint64_t dispatchedSeq() const {
+        return dispatched.load(std::memory_order_acquire);
+    }
+
+    // 序号不超过 seq 的记录不再需要回放
+    void ack(uint64_t seq) {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (used > 0) {
+            if (atWrap(ackPos)) {
+                used -= capacity - ackPos;
+                ackPos = 0;
+                continue;
+            }
+            if (getValue<uint64_t>(data + ackPos + 8) > seq) {
+                break;
+            }
+            advanceAck();
+        }
+        writeHeader();
+        stats.usedBytes.store(used, std::memory_order_relaxed);
+    }
+
+    // 把日志和文件头写到磁盘
+    void sync() {
+        auto begin = std::chrono::steady_clock::now();
+        ::msync(base, kHeaderBytes + capacity, MS_SYNC);
+        stats.syncs.fetch_add(1, std::memory_order_relaxed);
+        stats.syncUs.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin).count()));
+    }
+
+    uint64_t getCapacity() const { return capacity; }
+    const std::string& getPath() const { return path; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t capacity;
+        uint64_t ackSeq;
+        uint64_t ackOffset;
+        uint64_t generation;
+        uint32_t checksum;
+        uint32_t reserved;
+    };
+
+    enum : uint64_t {
+        kHeaderBytes = 4096,
+        kHeaderSlot = 64,
+        kRecordHeader = 16,
+        kVersion = 2,
+        kWrapMarker = 0xffffffffu,
+    };
+
+    std::string path;
+    uint64_t capacity;
+    int fd;
+    char* base;
+    char* data;
+
+    // 以下由 mutex 保护：writePos 只由采集线程修改，ackPos/ackSeq/used 在确认和覆盖时修改
+    std::mutex mutex;
+    uint64_t writePos;
+    uint64_t ackPos;
+    uint64_t ackSeq;
+    uint64_t nextSeq;
+    uint64_t used;
+    uint64_t headerWrites;
+    std::atomic<uint64_t> dispatched;
+    Stats stats;
+
+    template <typename T>
+    static char* putValue(char* p, T value) {
+        std::memcpy(p, &value, sizeof(value));
+        return p + sizeof(value);
+    }
+
+    template <typename T>
+    static T getValue(const char* p) {
+        T value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static char* putString(char* p, const char* text, size_t size) {
+        p = putValue<uint16_t>(p, static_cast<uint16_t>(size));
+        std::memcpy(p, text, size);
+        return p + size;
+    }
+
+    static uint64_t recordBytes(uint64_t payload) {
+        return (kRecordHeader + payload + 7) / 8 * 8;
+    }
+
+    static uint32_t checksum(const char* p, size_t size) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    // pos 之后放不下记录头，或写着回绕标记
+    bool atWrap(uint64_t pos) const {
+        return capacity - pos < kRecordHeader || getValue<uint32_t>(data + pos) == kWrapMarker;
+    }
+
+    void advanceAck() {
+        ackSeq = getValue<uint64_t>(data + ackPos + 8);
+        uint64_t size = recordBytes(getValue<uint32_t>(data + ackPos));
+        ackPos = (ackPos + size) % capacity;
+        used -= size;
+        stats.ackedSeq.store(ackSeq, std::memory_order_relaxed);
+    }
+
+    // 日志写满：丢弃最老的未确认记录
+    // 回绕时也要更新文件头，否则文件头里的旧位置之后被新记录覆盖，重启时从那里找不到下一条记录
+    void dropOldest() {
+        if (atWrap(ackPos)) {
+            used -= capacity - ackPos;
+            ackPos = 0;
+        } else {
+            advanceAck();
+            stats.overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        writeHeader();
+    }
+
+    bool readHeader(Header& header) {
+        bool found = false;
+        for (uint64_t slot = 0; slot < 2; ++slot) {
+            Header candidate;
+            if (::pread(fd, &candidate, sizeof(candidate), static_cast<off_t>(slot * kHeaderSlot)) != sizeof(candidate) ||
+                std::memcmp(candidate.magic, "MJNL", 4) != 0 || candidate.version != kVersion ||
+                candidate.checksum != checksum(reinterpret_cast<const char*>(&candidate), offsetof(Header, checksum))) {
+                continue;
+            }
+            if (!found || candidate.generation > header.generation) {
+                header = candidate;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void writeHeader() {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "MJNL", 4);
+        header.version = kVersion;
+        header.capacity = capacity;
+        header.ackSeq = ackSeq;
+        header.ackOffset = ackPos;
+        header.generation = headerWrites;
+        header.checksum = checksum(reinterpret_cast<const char*>(&header), offsetof(Header, checksum));
+        std::memcpy(base + (headerWrites++ % 2) * kHeaderSlot, &header, sizeof(header));
+    }
+
+    // 从确认位置开始顺着序号读出连续有效的记录，更新写入位置；callback 为空时只定位
+    size_t scan(const std::function<void(const Entry&)>* callback) {
+        uint64_t pos = ackPos;
+        uint64_t expected = ackSeq + 1;
+        uint64_t scanned = 0;
+        size_t count = 0;
+        Entry entry;
+        while (scanned < capacity) {
+            if (atWrap(pos)) {
+                scanned += capacity - pos;
+                pos = 0;
+                continue;
+            }
+            uint32_t payload = getValue<uint32_t>(data + pos);
+            uint64_t size = recordBytes(payload);
+            if (payload < 12 || size > capacity - pos || scanned + size > capacity ||
+                getValue<uint64_t>(data + pos + 8) != expected ||
+                getValue<uint32_t>(data + pos + 4) != checksum(data + pos + 8, 8 + payload)) {
+                break;
+            }
+            if (callback != nullptr && decode(data + pos + kRecordHeader, payload, entry)) {
+                entry.seq = expected;
+                (*callback)(entry);
+            }
+            ++count;
+            ++expected;
+            pos += size;
+            scanned += size;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        writePos = pos % capacity;
+        used = scanned;
+        nextSeq = expected;
+        return count;
+    }
+
+    static bool decode(const char* p, uint32_t payload, Entry& entry) {
+        const char* end = p + payload;
+        if (!getString(p, end, entry.uuid) || end - p < 10) {
+            return false;
+        }
+        entry.capturedAtMs = getValue<int64_t>(p);
+        uint16_t count = getValue<uint16_t>(p + 8);
+        p += 10;
+        entry.names.resize(count);
+        entry.values.resize(count);
+        for (uint16_t i = 0; i < count; ++i) {
+            if (!getString(p, end, entry.names[i]) || !getString(p, end, entry.values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool getString(const char*& p, const char* end, std::string& out) {
+        if (end - p < 2) {
+            return false;
+        }
+        uint16_t size = getValue<uint16_t>(p);
+        if (end - p - 2 < size) {
+            return false;
+        }
+        out.assign(p + 2, size);
+        p += 2 + size;
+        return true;
+    }
+};
+
+// 所有通道日志共用的后台线程：每 syncIntervalMs 把日志 msync 到磁盘，每 checkpointIntervalMs 做一次检查点——
+// 先记下各日志已分发的序号，barrier 确认这之前分发的数据在下游都有了结果后，把这些序号标记为已确认。
+class JournalCheckpointer {
+public:
+    using ptr = std::shared_ptr<JournalCheckpointer>;
+
+    using Clock = std::chrono::steady_clock;
+    // barrier 在 at 时刻通过的检查点，其数据是否都已写到文件；返回false时推迟确认
+    using Persisted = std::function<bool(Clock::time_point at)>;
+
+    std::atomic<uint64_t> checkpoints{0};
+    std::atomic<uint64_t> failedCheckpoints{0};
+    // 已通过、等待 persisted 的检查点数
+    std::atomic<uint64_t> heldCheckpoints{0};
+
+    // persisted 为空时检查点通过即确认
+    JournalCheckpointer(const std::vector<SampleJournal::ptr>& journals, const std::function<bool()>& barrier,
+                        int syncIntervalMs, int checkpointIntervalMs, const Persisted& persisted = nullptr)
+        : journals(journals), barrier(barrier), persisted(persisted), syncIntervalMs(std::max(syncIntervalMs, 1)),
+          checkpointIntervalMs(std::max(checkpointIntervalMs, 1)), running(false) {}
+
+    ~JournalCheckpointer() {
+        stop();
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        worker = std::thread([this](){
+            run();
+        });
+    }
+
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_all();
+        }
+        if (worker.joinable()) {
+            worker.join();
+        }
+        for (const auto& journal : journals) {
+            journal->sync();
+        }
+    }
+
+private:
+    struct Held {
+        Clock::time_point at;
+        std::vector<uint64_t> dispatched;
+    };
+
+    enum { kMaxHeld = 1024 };
+
+    std::vector<SampleJournal::ptr> journals;
+    std::function<bool()> barrier;
+    Persisted persisted;
+    // 按时间顺序，后一个检查点的确认位置覆盖前一个
+    std::deque<Held> held;
+    int syncIntervalMs;
+    int checkpointIntervalMs;
+    std::atomic<bool> running;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread worker;
+
+    void run() {
+        auto nextSync = std::chrono::steady_clock::now() + std::chrono::milliseconds(syncIntervalMs);
+        auto nextCheckpoint = std::chrono::steady_clock::now() + std::chrono::milliseconds(checkpointIntervalMs);
+        while (running.load()) {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_until(lock, std::min(nextSync, nextCheckpoint), [this]{
+                    return !running.load();
+                });
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= nextCheckpoint) {
+                checkpoint();
+                nextCheckpoint = now + std::chrono::milliseconds(checkpointIntervalMs);
+            }
+            if (now >= nextSync) {
+                for (const auto& journal : journals) {
+                    journal->sync();
+                }
+                nextSync = now + std::chrono::milliseconds(syncIntervalMs);
+            }
+        }
+    }
+
+    void checkpoint() {
+        std::vector<uint64_t> dispatched;
+        for (const auto& journal : journals) {
+            dispatched.push_back(journal->dispatchedSeq());
+        }
+        if (!barrier()) {
+            failedCheckpoints.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            checkpoints.fetch_add(1, std::memory_order_relaxed);
+            held.push_back(Held{Clock::now(), std::move(dispatched)});
+            if (held.size() > kMaxHeld) {
+                held.pop_front();
+            }
+        }
+        // 确认最后一个数据都已写到文件的检查点
+        bool ack = false;
+        while (!held.empty() && (!persisted || persisted(held.front().at))) {
+            dispatched.swap(held.front().dispatched);
+            held.pop_front();
+            ack = true;
+        }
+        if (ack) {
+            for (size_t i = 0; i < journals.size(); ++i) {
+                if (dispatched[i] > 0) {
+                    journals[i]->ack(dispatched[i]);
+                }
+            }
+        }
+        heldCheckpoints.store(held.size(), std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,600 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gorilla.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 采集历史的二进制分列存储，每个设备一个只追加的文件 <uuid>.seg
+//
+// 文件头：char[4] "MSEG" | u16 版本 | u16 字段数 | (u16 长度 | 字段名)... | 补齐到8字节
+// 之后是连续的块，每块最多 blockSamples 条采样，每列单独存放。不压缩的块列定长：
+//   u32 "BLK1" | u32 条数n | i64 时间(epoch ms) x n | f64 字段0 x n | f64 字段1 x n | ...
+// 压缩的块每列用 Gorilla 编码（见 gorilla.h），块头带各列的字节数：
+//   u32 "BLK2" | u32 条数n | u32 列字节数 x (1 + 字段数) | 时间列 | 字段0列 | ...
+// 两种块的块尾相同：i64 最小时间 | i64 最大时间 | (f64 最小值 | f64 最大值) x 字段数 | u32 条数n | u32 校验
+// 校验为块开头到校验之前所有字节的 FNV-1a。数值按主机字节序（小端）保存，非数值字段为 NaN，不参与最小/最大值。
+// 查询先只读每块的块头和块尾，时间范围不重叠的块跳过，重叠的块只读时间列和需要的字段列。
+
+using SegmentFields = std::shared_ptr<const std::vector<std::string>>;
+
+struct SegmentConfig {
+    std::string directory = ".";
+    uint32_t blockSamples = 128;
+    int flushIntervalMs = 60000;
+    bool compress = true;
+};
+
+// 一个块的块头和块尾
+struct SegmentBlock {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t count = 0;
+    bool compressed = false;
+    // 第0列为时间，之后依次为各字段；offset 为在文件中的绝对位置
+    std::vector<uint64_t> columnOffsets;
+    std::vector<uint32_t> columnBytes;
+    int64_t minTime = 0;
+    int64_t maxTime = 0;
+    std::vector<double> minValues;
+    std::vector<double> maxValues;
+};
+
+enum {
+    kSegmentVersion = 1,
+    kSegmentBlockHeader = 8,
+};
+
+inline uint32_t segmentChecksum(const char* data, size_t size, uint32_t h = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+inline uint64_t segmentFooterBytes(size_t fieldCount) {
+    return 16 + 16 * fieldCount + 8;
+}
+
+
+template <typename T>
+inline void putSegmentValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+inline T getSegmentValue(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline std::string encodeSegmentHeader(const std::vector<std::string>& fields) {
+    std::string header("MSEG", 4);
+    putSegmentValue<uint16_t>(header, kSegmentVersion);
+    putSegmentValue<uint16_t>(header, static_cast<uint16_t>(fields.size()));
+    for (const auto& field : fields) {
+        putSegmentValue<uint16_t>(header, static_cast<uint16_t>(field.size()));
+        header.append(field);
+    }
+    header.resize((header.size() + 7) / 8 * 8, '\0');
+    return header;
+}
+
+inline bool preadFull(int fd, char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// 读取文件头，返回文件头长度，格式不对时返回0
+inline uint64_t readSegmentHeader(int fd, std::vector<std::string>& fields) {
+    char fixed[8];
+    if (!preadFull(fd, fixed, sizeof(fixed), 0) || std::memcmp(fixed, "MSEG", 4) != 0 ||
+        getSegmentValue<uint16_t>(fixed + 4) != kSegmentVersion) {
+        return 0;
+    }
+    uint16_t count = getSegmentValue<uint16_t>(fixed + 6);
+    uint64_t offset = sizeof(fixed);
+    fields.clear();
+    for (uint16_t i = 0; i < count; ++i) {
+        char length[2];
+        if (!preadFull(fd, length, sizeof(length), offset)) {
+            return 0;
+        }
+        std::string field(getSegmentValue<uint16_t>(length), '\0');
+        if (!field.empty() && !preadFull(fd, &field[0], field.size(), offset + 2)) {
+            return 0;
+        }
+        offset += 2 + field.size();
+        fields.push_back(field);
+    }
+    return (offset + 7) / 8 * 8;
+}
+
+// 读取 offset 处的块头和块尾，块不完整（例如写入时断电）时返回false
+inline bool readSegmentBlock(int fd, uint64_t offset, uint64_t fileSize, size_t fieldCount, SegmentBlock& block) {
+    char header[kSegmentBlockHeader];
+    if (offset + kSegmentBlockHeader > fileSize || !preadFull(fd, header, sizeof(header), offset) ||
+        (std::memcmp(header, "BLK1", 4) != 0 && std::memcmp(header, "BLK2", 4) != 0)) {
+        return false;
+    }
+    uint32_t count = getSegmentValue<uint32_t>(header + 4);
+    bool compressed = std::memcmp(header, "BLK2", 4) == 0;
+    if (count == 0) {
+        return false;
+    }
+    block.columnBytes.assign(fieldCount + 1, static_cast<uint32_t>(8ull * count));
+    uint64_t headerBytes = kSegmentBlockHeader;
+    if (compressed) {
+        headerBytes += 4 * (fieldCount + 1);
+        if (offset + headerBytes > fileSize ||
+            !preadFull(fd, reinterpret_cast<char*>(block.columnBytes.data()), 4 * (fieldCount + 1), offset + kSegmentBlockHeader)) {
+            return false;
+        }
+    }
+    block.columnOffsets.resize(fieldCount + 1);
+    uint64_t size = headerBytes;
+    for (size_t i = 0; i <= fieldCount; ++i) {
+        block.columnOffsets[i] = offset + size;
+        size += block.columnBytes[i];
+    }
+    size += segmentFooterBytes(fieldCount);
+    if (offset + size > fileSize) {
+        return false;
+    }
+    std::vector<char> footer(segmentFooterBytes(fieldCount));
+    if (!preadFull(fd, footer.data(), footer.size(), offset + size - footer.size())) {
+        return false;
+    }
+    const char* p = footer.data();
+    if (getSegmentValue<uint32_t>(p + footer.size() - 8) != count) {
+        return false;
+    }
+    block.offset = offset;
+    block.size = size;
+    block.count = count;
+    block.compressed = compressed;
+    block.minTime = getSegmentValue<int64_t>(p);
+    block.maxTime = getSegmentValue<int64_t>(p + 8);
+    block.minValues.resize(fieldCount);
+    block.maxValues.resize(fieldCount);
+    for (size_t i = 0; i < fieldCount; ++i) {
+        block.minValues[i] = getSegmentValue<double>(p + 16 + 16 * i);
+        block.maxValues[i] = getSegmentValue<double>(p + 24 + 16 * i);
+    }
+    return true;
+}
+
+// 设备历史的写入端，只在一个线程（文件写线程）中使用，统计可在其他线程读取
+// 每个设备在内存中攒一个块，攒满 blockSamples 条或距第一条超过 flushIntervalMs 时追加到文件；
+// 文件只在写块时打开，写完即关闭，设备数多时也不占用文件描述符。
+class SegmentStore {
+public:
+    using ptr = std::shared_ptr<SegmentStore>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> blocks{0};
+        std::atomic<uint64_t> bytes{0};
+        // 列数据编码前（每个值8字节）和编码后的字节数，不含块头块尾
+        std::atomic<uint64_t> rawBytes{0};
+        std::atomic<uint64_t> columnBytes{0};
+        std::atomic<uint64_t> rotations{0};
+        std::atomic<uint64_t> truncatedBytes{0};
+        std::atomic<uint64_t> errors{0};
+    };
+
+    explicit SegmentStore(const SegmentConfig& config = SegmentConfig()) : config(config) {
+        if (this->config.blockSamples == 0) {
+            this->config.blockSamples = 1;
+        }
+    }
+
+    ~SegmentStore() {
+        flushAll();
+    }
+
+    // values 依次对应 fields，不足的字段记为 NaN；字段变化时先写出之前攒下的块
+    void append(const std::string& uuid, const SegmentFields& fields, int64_t timeMs, const double* values, size_t count) {
+        Pending& pending = devices[uuid];
+        if (pending.fields && pending.fields != fields && *pending.fields != *fields) {
+            writeBlock(uuid, pending);
+            pending.checked = false;
+        }
+        if (pending.times.empty()) {
+            pending.firstAt = Clock::now();
+            pending.fields = fields;
+        }
+        pending.times.push_back(timeMs);
+        size_t fieldCount = fields->size();
+        for (size_t i = 0; i < fieldCount; ++i) {
+            pending.values.push_back(i < count ? values[i] : std::numeric_limits<double>::quiet_NaN());
+        }
+        stats.samples.fetch_add(1, std::memory_order_relaxed);
+        if (pending.times.size() >= config.blockSamples) {
+            writeBlock(uuid, pending);
+        }
+    }
+
+    // 还在内存中的采样里最早进入的时刻，没有时为 time_point::max()；在此之前 append 的采样都已写到文件
+    Clock::time_point pendingSince() const {
+        Clock::time_point since = Clock::time_point::max();
+        for (const auto& kv : devices) {
+            if (!kv.second.times.empty()) {
+                since = std::min(since, kv.second.firstAt);
+            }
+        }
+        return since;
+    }
+
+    // 写出攒了超过 flushIntervalMs 的块
+    void flushDue() {
+        auto threshold = Clock::now() - std::chrono::milliseconds(config.flushIntervalMs);
+        for (auto& kv : devices) {
+            if (!kv.second.times.empty() && kv.second.firstAt <= threshold) {
+                writeBlock(kv.first, kv.second);
+            }
+        }
+    }
+
+    void flushAll() {
+        for (auto& kv : devices) {
+            writeBlock(kv.first, kv.second);
+        }
+    }
+
+    std::string pathOf(const std::string& uuid) const {
+        return config.directory + "/" + uuid + ".seg";
+    }
+
+    const SegmentConfig& getConfig() const { return config; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Pending {
+        SegmentFields fields;
+        std::vector<int64_t> times;
+        // 按行保存，写块时转成列
+        std::vector<double> values;
+        Clock::time_point firstAt;
+        // 本进程是否已经检查过文件头和文件末尾
+        bool checked = false;
+    };
+
+    SegmentConfig config;
+    std::unordered_map<std::string, Pending> devices;
+    std::string block;
+    BitWriter bits;
+    std::vector<double> column;
+    Stats stats;
+
+    void writeBlock(const std::string& uuid, Pending& pending) {
+        if (pending.times.empty()) {
+            return;
+        }
+        const std::vector<std::string>& fields = *pending.fields;
+        std::string path = pathOf(uuid);
+        if (!pending.checked) {
+            pending.checked = prepareFile(path, fields);
+        }
+        if (pending.checked) {
+            encodeBlock(pending);
+            int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+            if (fd < 0 || !writeFull(fd, block.data(), block.size())) {
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "Failed to write segment " << path << ": " << std::strerror(errno) << std::endl;
+                // 下次写块前重新检查文件末尾，截掉写了一半的块
+                pending.checked = false;
+            } else {
+                stats.blocks.fetch_add(1, std::memory_order_relaxed);
+                stats.bytes.fetch_add(block.size(), std::memory_order_relaxed);
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        pending.times.clear();
+        pending.values.clear();
+    }
+
+    void encodeBlock(const Pending& pending) {
+        const size_t fieldCount = pending.fields->size();
+        const uint32_t count = static_cast<uint32_t>(pending.times.size());
+        block.clear();
+        block.append(config.compress ? "BLK2" : "BLK1", 4);
+        putSegmentValue<uint32_t>(block, count);
+        size_t sizesAt = block.size();
+        if (config.compress) {
+            block.resize(block.size() + 4 * (fieldCount + 1));
+            bits.clear();
+            encodeGorillaTimes(pending.times.data(), count, bits);
+            appendColumn(sizesAt, 0, bits.finish());
+        } else {
+            for (int64_t time : pending.times) {
+                putSegmentValue<int64_t>(block, time);
+            }
+        }
+        std::vector<double> minValues(fieldCount, std::numeric_limits<double>::quiet_NaN());
+        std::vector<double> maxValues(fieldCount, std::numeric_limits<double>::quiet_NaN());
+        for (size_t f = 0; f < fieldCount; ++f) {
+            column.resize(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                double value = pending.values[i * fieldCount + f];
+                column[i] = value;
+                if (std::isnan(value)) {
+                    continue;
+                }
+                if (std::isnan(minValues[f]) || value < minValues[f]) {
+                    minValues[f] = value;
+                }
+                if (std::isnan(maxValues[f]) || value > maxValues[f]) {
+                    maxValues[f] = value;
+                }
+            }
+            if (config.compress) {
+                bits.clear();
+                encodeGorillaValues(column.data(), count, bits);
+                appendColumn(sizesAt, f + 1, bits.finish());
+            } else {
+                block.append(reinterpret_cast<const char*>(column.data()), 8ull * count);
+            }
+        }
+        putSegmentValue<int64_t>(block, *std::min_element(pending.times.begin(), pending.times.end()));
+        putSegmentValue<int64_t>(block, *std::max_element(pending.times.begin(), pending.times.end()));
+        for (size_t f = 0; f < fieldCount; ++f) {
+            putSegmentValue<double>(block, minValues[f]);
+            putSegmentValue<double>(block, maxValues[f]);
+        }
+        putSegmentValue<uint32_t>(block, count);
+        putSegmentValue<uint32_t>(block, segmentChecksum(block.data(), block.size()));
+        stats.rawBytes.fetch_add(8ull * count * (fieldCount + 1), std::memory_order_relaxed);
+        stats.columnBytes.fetch_add(block.size() - sizesAt - (config.compress ? 4 * (fieldCount + 1) : 0) - segmentFooterBytes(fieldCount),
+                                    std::memory_order_relaxed);
+    }
+
+    void appendColumn(size_t sizesAt, size_t index, const std::string& data) {
+        uint32_t size = static_cast<uint32_t>(data.size());
+        std::memcpy(&block[sizesAt + 4 * index], &size, sizeof(size));
+        block.append(data);
+    }
+
+    // 新文件写入文件头；已有文件字段相同时截掉末尾不完整的块，字段不同时改名为 <uuid>.<时间>.seg 另起新文件
+    bool prepareFile(const std::string& path, const std::vector<std::string>& fields) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "Failed to open segment " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st;
+        uint64_t fileSize = fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+        if (fileSize > 0) {
+            std::vector<std::string> existing;
+            uint64_t offset = readSegmentHeader(fd, existing);
+            if (offset > 0 && existing == fields) {
+                SegmentBlock info;
+                while (readSegmentBlock(fd, offset, fileSize, fields.size(), info)) {
+                    offset += info.size;
+                }
+                bool ok = true;
+                if (offset < fileSize) {
+                    stats.truncatedBytes.fetch_add(fileSize - offset, std::memory_order_relaxed);
+                    ok = ::ftruncate(fd, static_cast<off_t>(offset)) == 0;
+                }
+                ::close(fd);
+                return ok;
+            }
+            ::close(fd);
+            std::string rotated = path.substr(0, path.size() - 4) + "." + std::to_string(
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()) + ".seg";
+            if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            stats.rotations.fetch_add(1, std::memory_order_relaxed);
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                stats.errors.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        std::string header = encodeSegmentHeader(fields);
+        bool ok = writeFull(fd, header.data(), header.size());
+        ::close(fd);
+        return ok;
+    }
+
+    static bool writeFull(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+};
+
+// 设备历史的读取端
+class SegmentReader {
+public:
+    SegmentReader() : fd(-1), dataOffset(0), fileSize(0), tailBytes(0), bytesRead(0) {}
+
+    ~SegmentReader() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // 读取文件头和所有块的块头/块尾
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        fileSize = static_cast<uint64_t>(st.st_size);
+        dataOffset = readSegmentHeader(fd, fields);
+        if (dataOffset == 0) {
+            error = "not a segment file";
+            return false;
+        }
+        uint64_t offset = dataOffset;
+        SegmentBlock block;
+        while (readSegmentBlock(fd, offset, fileSize, fields.size(), block)) {
+            blocks.push_back(block);
+            offset += block.size;
+            bytesRead += block.columnOffsets[0] - block.offset + segmentFooterBytes(fields.size());
+        }
+        // 末尾不完整的块（正在写入或写入时断电）不读
+        tailBytes = fileSize - offset;
+        return true;
+    }
+
+    int fieldIndex(const std::string& name) const {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            if (fields[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // 读取 [fromMs, toMs] 内的采样，columns 为字段下标；values[c] 对应 columns[c]
+    bool read(int64_t fromMs, int64_t toMs, const std::vector<int>& columns,
+              std::vector<int64_t>& times, std::vector<std::vector<double>>& values) {
+        times.clear();
+        values.assign(columns.size(), std::vector<double>());
+        std::vector<int64_t> blockTimes;
+        std::vector<double> column;
+        for (const SegmentBlock& block : blocks) {
+            if (block.maxTime < fromMs || block.minTime > toMs) {
+                continue;
+            }
+            if (!readTimes(block, blockTimes)) {
+                return false;
+            }
+            std::vector<uint32_t> rows;
+            for (uint32_t i = 0; i < block.count; ++i) {
+                if (blockTimes[i] >= fromMs && blockTimes[i] <= toMs) {
+                    rows.push_back(i);
+                    times.push_back(blockTimes[i]);
+                }
+            }
+            for (size_t c = 0; c < columns.size(); ++c) {
+                if (!readValues(block, columns[c], column)) {
+                    return false;
+                }
+                for (uint32_t row : rows) {
+                    values[c].push_back(column[row]);
+                }
+            }
+        }
+        return true;
+    }
+
+    // 读取整个块校验，只在检查文件时使用
+    bool verify(const SegmentBlock& block) {
+        std::vector<char> data(block.size);
+        if (!preadFull(fd, data.data(), data.size(), block.offset)) {
+            return false;
+        }
+        bytesRead += data.size();
+        return segmentChecksum(data.data(), data.size() - 4) == getSegmentValue<uint32_t>(data.data() + data.size() - 4);
+    }
+
+    const std::vector<std::string>& getFields() const { return fields; }
+    const std::vector<SegmentBlock>& getBlocks() const { return blocks; }
+    uint64_t getFileSize() const { return fileSize; }
+    uint64_t getTailBytes() const { return tailBytes; }
+    uint64_t getBytesRead() const { return bytesRead; }
+    const std::string& getError() const { return error; }
+
+private:
+    int fd;
+    std::vector<std::string> fields;
+    std::vector<SegmentBlock> blocks;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+    uint64_t tailBytes;
+    uint64_t bytesRead;
+    std::string error;
+
+    std::vector<char> encoded;
+
+    bool readTimes(const SegmentBlock& block, std::vector<int64_t>& out) {
+        out.resize(block.count);
+        if (!readColumn(block, 0, reinterpret_cast<char*>(out.data()))) {
+            return false;
+        }
+        if (block.compressed && !decodeGorillaTimes(encoded.data(), encoded.size(), block.count, out.data())) {
+            error = "corrupted time column in block at " + std::to_string(block.offset);
+            return false;
+        }
+        return true;
+    }
+
+    bool readValues(const SegmentBlock& block, int field, std::vector<double>& out) {
+        out.resize(block.count);
+        if (!readColumn(block, field + 1, reinterpret_cast<char*>(out.data()))) {
+            return false;
+        }
+        if (block.compressed && !decodeGorillaValues(encoded.data(), encoded.size(), block.count, out.data())) {
+            error = "corrupted column " + fields[field] + " in block at " + std::to_string(block.offset);
+            return false;
+        }
+        return true;
+    }
+
+    // 不压缩的列直接读到 out，压缩的列读到 encoded 再解码
+    bool readColumn(const SegmentBlock& block, size_t index, char* out) {
+        size_t size = block.columnBytes[index];
+        char* target = out;
+        if (block.compressed) {
+            encoded.resize(size);
+            target = encoded.data();
+        }
+        if (!preadFull(fd, target, size, block.columnOffsets[index])) {
+            error = "failed to read block at " + std::to_string(block.offset);
+            return false;
+        }
+        bytesRead += size;
+        return true;
+    }
+};
@@ -0,0 +1,148 @@
+// 查看设备历史分列文件(.seg)
+// 默认打印字段、块数、采样数、时间范围、每条采样的平均字节数和每列的压缩率，再按时间范围打印采样；
+// --blocks 只打印每块的块尾（条数、时间范围、各字段最小/最大值），--verify 读取整个文件检查校验。
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "segment.h"
+
+int main(int argc, char* argv[]) {
+    std::string path;
+    int64_t fromMs = std::numeric_limits<int64_t>::min();
+    int64_t toMs = std::numeric_limits<int64_t>::max();
+    std::string fieldList;
+    bool blocksOnly = false;
+    bool verify = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--from" && hasValue) {
+            fromMs = std::strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "--to" && hasValue) {
+            toMs = std::strtoll(argv[++i], nullptr, 10);
+        } else if (arg == "--fields" && hasValue) {
+            fieldList = argv[++i];
+        } else if (arg == "--blocks") {
+            blocksOnly = true;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (path.empty() && arg[0] != '-') {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty()) {
+        std::cout << "Usage: SegmentDump FILE.seg [--from MS] [--to MS] [--fields a,b] [--blocks] [--verify]" << std::endl;
+        return 1;
+    }
+
+    SegmentReader reader;
+    if (!reader.open(path)) {
+        std::cerr << path << ": " << reader.getError() << std::endl;
+        return 1;
+    }
+    const std::vector<std::string>& fields = reader.getFields();
+    const std::vector<SegmentBlock>& blocks = reader.getBlocks();
+    uint64_t samples = 0;
+    for (const auto& block : blocks) {
+        samples += block.count;
+    }
+    std::cout << "fields:";
+    for (const auto& field : fields) {
+        std::cout << " " << field;
+    }
+    std::cout << std::endl << "blocks: " << blocks.size() << ", samples: " << samples << ", file bytes: " << reader.getFileSize();
+    if (samples > 0) {
+        std::cout << " (" << static_cast<double>(reader.getFileSize()) / samples << " bytes/sample), time: "
+                  << blocks.front().minTime << " .. " << blocks.back().maxTime;
+    }
+    std::cout << std::endl;
+    // 每列实际占用的字节数与定长（每个值8字节）相比
+    if (samples > 0) {
+        std::vector<uint64_t> columnBytes(fields.size() + 1, 0);
+        for (const auto& block : blocks) {
+            for (size_t i = 0; i < block.columnBytes.size(); ++i) {
+                columnBytes[i] += block.columnBytes[i];
+            }
+        }
+        for (size_t i = 0; i < columnBytes.size(); ++i) {
+            std::cout << "  " << (i == 0 ? std::string("captured-at") : fields[i - 1]) << ": " << columnBytes[i] << " bytes, "
+                      << columnBytes[i] * 8.0 / samples << " bits/sample, ratio " << samples * 8.0 / columnBytes[i] << std::endl;
+        }
+    }
+    if (reader.getTailBytes() > 0) {
+        std::cout << "incomplete tail: " << reader.getTailBytes() << " bytes" << std::endl;
+    }
+
+    if (verify) {
+        size_t bad = 0;
+        for (const auto& block : blocks) {
+            if (!reader.verify(block)) {
+                std::cout << "checksum mismatch in block at " << block.offset << std::endl;
+                ++bad;
+            }
+        }
+        std::cout << "verified " << blocks.size() << " blocks, " << bad << " bad" << std::endl;
+        return bad == 0 ? 0 : 2;
+    }
+
+    if (blocksOnly) {
+        for (const auto& block : blocks) {
+            std::cout << "@" << block.offset << " count " << block.count << " time " << block.minTime << " .. " << block.maxTime;
+            for (size_t i = 0; i < fields.size(); ++i) {
+                std::cout << " " << fields[i] << " [" << block.minValues[i] << ", " << block.maxValues[i] << "]";
+            }
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+
+    std::vector<int> columns;
+    std::vector<std::string> names;
+    if (fieldList.empty()) {
+        for (size_t i = 0; i < fields.size(); ++i) {
+            columns.push_back(static_cast<int>(i));
+            names.push_back(fields[i]);
+        }
+    } else {
+        std::stringstream ss(fieldList);
+        std::string name;
+        while (std::getline(ss, name, ',')) {
+            int index = reader.fieldIndex(name);
+            if (index < 0) {
+                std::cerr << "unknown field: " << name << std::endl;
+                return 1;
+            }
+            columns.push_back(index);
+            names.push_back(name);
+        }
+    }
+
+    uint64_t headerBytes = reader.getBytesRead();
+    std::vector<int64_t> times;
+    std::vector<std::vector<double>> values;
+    if (!reader.read(fromMs, toMs, columns, times, values)) {
+        std::cerr << path << ": " << reader.getError() << std::endl;
+        return 1;
+    }
+    std::cout << "captured-at";
+    for (const auto& name : names) {
+        std::cout << "," << name;
+    }
+    std::cout << std::endl;
+    for (size_t r = 0; r < times.size(); ++r) {
+        std::cout << times[r];
+        for (size_t c = 0; c < columns.size(); ++c) {
+            std::cout << "," << values[c][r];
+        }
+        std::cout << std::endl;
+    }
+    std::cerr << times.size() << " samples, read " << reader.getBytesRead() - headerBytes << " column bytes + "
+              << headerBytes << " block header/footer bytes of " << reader.getFileSize() << std::endl;
+    return 0;
+}
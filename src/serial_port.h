@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <unistd.h>
+
+// 串口参数，对应 serial_config.json 中的 dev 块
+struct SerialPortConfig {
+    std::string instance;
+    int baudRate = 9600;
+    int dataBits = 8;
+    std::string parity = "n";
+    std::string stopBits = "1";
+    int responseTimeoutMs = 100;
+
+    // 每个字符在线上占用的位数：起始位 + 数据位 + 校验位 + 停止位
+    int bitsPerChar() const {
+        int parityBits = (parity.empty() || std::tolower(parity[0]) == 'n') ? 0 : 1;
+        int stop = stopBits == "2" ? 2 : 1;
+        return 1 + dataBits + parityBits + stop;
+    }
+
+    // 传输n个字符所需的时间(us)
+    int64_t charsToMicros(double chars) const {
+        return static_cast<int64_t>(chars * bitsPerChar() * 1000000.0 / (baudRate > 0 ? baudRate : 9600));
+    }
+
+    // Modbus RTU 帧间隔 t3.5，波特率高于19200时固定为1750us
+    int64_t interFrameMicros() const {
+        if (baudRate > 19200) {
+            return 1750;
+        }
+        return charsToMicros(3.5);
+    }
+};
+
+inline speed_t toTermiosBaud(int baudRate) {
+    switch (baudRate) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+// 以非阻塞方式打开串口并按配置设置为原始模式，失败返回-1
+inline int openSerialPort(const SerialPortConfig& config) {
+    int fd = ::open(config.instance.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open serial port " << config.instance << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        std::cerr << "Failed to get attributes of " << config.instance << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+
+    speed_t speed = toTermiosBaud(config.baudRate);
+    if (speed == B0) {
+        std::cerr << "Unsupported baud rate " << config.baudRate << " for " << config.instance << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    tio.c_cflag &= ~CSIZE;
+    switch (config.dataBits) {
+        case 5: tio.c_cflag |= CS5; break;
+        case 6: tio.c_cflag |= CS6; break;
+        case 7: tio.c_cflag |= CS7; break;
+        default: tio.c_cflag |= CS8; break;
+    }
+
+    char parity = config.parity.empty() ? 'n' : static_cast<char>(std::tolower(config.parity[0]));
+    if (parity == 'e') {
+        tio.c_cflag |= PARENB;
+        tio.c_cflag &= ~PARODD;
+    } else if (parity == 'o') {
+        tio.c_cflag |= PARENB | PARODD;
+    } else {
+        tio.c_cflag &= ~PARENB;
+    }
+
+    if (config.stopBits == "2") {
+        tio.c_cflag |= CSTOPB;
+    } else {
+        tio.c_cflag &= ~CSTOPB;
+    }
+
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~CRTSCTS;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        std::cerr << "Failed to configure serial port " << config.instance << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+// 半双工请求/应答的传输层
+class SerialTransport {
+public:
+    virtual ~SerialTransport() {}
+
+    // 发送请求并接收一帧应答；expectedLength 为已知的应答长度（0表示未知，以帧间隔判断结束）
+    // completedAt 为收到完整应答（或超时）的时刻；超时或出错返回false
+    virtual bool transact(const std::vector<uint8_t>& request, size_t expectedLength,
+                          std::vector<uint8_t>& response, int timeoutMs,
+                          std::chrono::steady_clock::time_point& completedAt) = 0;
+};
+
+// 主动上报数据的读取者：由事件循环在串口可读且没有等待中的应答时调用
+class SerialStreamReader {
+public:
+    virtual ~SerialStreamReader() {}
+
+    // 从fd读取可用数据，返回值同read
+    virtual ssize_t readFrom(int fd) = 0;
+
+    // 收到数据后总线静默超过 t3.5
+    virtual void onSilence() = 0;
+};
@@ -0,0 +1,614 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "serial_port.h"
+
+// 所有串口共用的epoll事件循环
+// 每个串口非阻塞打开并配一个timerfd：等待应答时作为应答超时，接收过程中作为 t3.5 帧间隔，
+// 一帧结束后再作为发送下一帧前的静默间隔。请求在各自串口上排队，串口之间互不影响。
+// 串口出错（如USB转485拔出）时关闭它，其间的请求立即失败；timerfd 改作重新打开的退避定时器，
+// 从1s开始每次失败加倍，最长30s，重新打开后恢复收发。
+class SerialReactor {
+public:
+    using ptr = std::shared_ptr<SerialReactor>;
+    using Clock = std::chrono::steady_clock;
+    // ok 为false表示超时或串口出错；data 只在回调期间有效；completedAt 为收到完整帧的时刻
+    using ResponseCallback = std::function<void(bool ok, const uint8_t* data, size_t size, Clock::time_point completedAt)>;
+
+    struct PortStats {
+        std::atomic<uint64_t> transactions{0};
+        std::atomic<uint64_t> timeouts{0};
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> bytesRead{0};
+        std::atomic<uint64_t> unsolicitedBytes{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> reopens{0};
+    };
+
+    SerialReactor() : epollFd(-1), wakeFd(-1), running(false) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) {
+            std::cerr << "Failed to create serial reactor: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = kWakeToken;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    }
+
+    ~SerialReactor() {
+        stop();
+        for (auto& port : ports) {
+            closePort(*port);
+        }
+        if (wakeFd >= 0) {
+            ::close(wakeFd);
+        }
+        if (epollFd >= 0) {
+            ::close(epollFd);
+        }
+    }
+
+    // 打开串口并加入事件循环，返回串口编号，失败返回-1；需在start()之前调用
+    int addPort(const SerialPortConfig& config) {
+        if (epollFd < 0) {
+            return -1;
+        }
+        int fd = openSerialPort(config);
+        if (fd < 0) {
+            return -1;
+        }
+        int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timerFd < 0) {
+            std::cerr << "Failed to create timer for " << config.instance << ": " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return -1;
+        }
+
+        int id = static_cast<int>(ports.size());
+        std::unique_ptr<Port> port(new Port());
+        port->id = id;
+        port->config = config;
+        port->fd = fd;
+        port->timerFd = timerFd;
+        port->gapNanos = config.interFrameMicros() * 1000;
+        port->openedAt = Clock::now();
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = tokenOf(id, PortEvent);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        event.events = EPOLLIN;
+        event.data.u64 = tokenOf(id, TimerEvent);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+
+        ports.push_back(std::move(port));
+        return id;
+    }
+
+    // 接收主动上报的数据：串口上没有等待中的应答时，可读数据都交给reader，
+    // 每批数据后静默超过 t3.5 时调用 reader->onSilence()；需在start()之前调用
+    bool setStreamReader(int portId, SerialStreamReader* reader) {
+        if (portId < 0 || portId >= static_cast<int>(ports.size())) {
+            return false;
+        }
+        Port& port = *ports[portId];
+        if (port.streamTimerFd < 0) {
+            port.streamTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (port.streamTimerFd < 0) {
+                std::cerr << "Failed to create timer for " << port.config.instance << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = tokenOf(portId, StreamTimerEvent);
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, port.streamTimerFd, &event);
+        }
+        port.streamReader = reader;
+        return true;
+    }
+
+    void start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        loop = std::thread([this](){
+            run();
+        });
+    }
+
+    void stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        wake();
+        if (loop.joinable()) {
+            loop.join();
+        }
+    }
+
+    // 提交一次请求/应答事务（线程安全），回调在事件循环线程中执行
+    void submit(int portId, const std::vector<uint8_t>& request, size_t expectedLength, int timeoutMs,
+                const ResponseCallback& callback) {
+        if (portId < 0 || portId >= static_cast<int>(ports.size()) || !running.load()) {
+            callback(false, nullptr, 0, Clock::now());
+            return;
+        }
+        Transaction transaction;
+        transaction.request = request;
+        transaction.expectedLength = expectedLength;
+        transaction.timeoutMs = timeoutMs;
+        transaction.callback = callback;
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            inbox.push_back(std::make_pair(portId, std::move(transaction)));
+        }
+        wake();
+    }
+
+    // 只发送不等待应答（线程安全）；连续排队的发送会合并成一次写，帧之间不插入静默间隔
+    void send(int portId, const std::vector<uint8_t>& data) {
+        if (portId < 0 || portId >= static_cast<int>(ports.size()) || !running.load()) {
+            return;
+        }
+        Transaction transaction;
+        transaction.request = data;
+        transaction.expectResponse = false;
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            inbox.push_back(std::make_pair(portId, std::move(transaction)));
+        }
+        wake();
+    }
+
+    const SerialPortConfig& configOf(int portId) const {
+        return ports[portId]->config;
+    }
+
+    const PortStats& statsOf(int portId) const {
+        return ports[portId]->stats;
+    }
+
+private:
+    enum State {
+        Idle,
+        Writing,
+        AwaitingResponse,
+        Receiving,
+        Silence,
+    };
+
+    struct Transaction {
+        std::vector<uint8_t> request;
+        bool expectResponse = true;
+        size_t expectedLength = 0;
+        int timeoutMs = 0;
+        ResponseCallback callback;
+    };
+
+    enum EventKind {
+        PortEvent,
+        TimerEvent,
+        StreamTimerEvent,
+    };
+
+    struct Port {
+        int id = 0;
+        SerialPortConfig config;
+        int fd = -1;
+        int timerFd = -1;
+        int streamTimerFd = -1;
+        SerialStreamReader* streamReader = nullptr;
+        int64_t gapNanos = 0;
+        // failed 期间 fd 已关闭，timerFd 到期时尝试重新打开
+        bool failed = false;
+        int reopenBackoffMs = 0;
+        Clock::time_point openedAt;
+        State state = Idle;
+        size_t written = 0;
+        std::deque<Transaction> pending;
+        Transaction current;
+        std::vector<uint8_t> rx;
+        PortStats stats;
+    };
+
+    static const uint64_t kWakeToken = ~0ull;
+
+    enum { kReopenMinMs = 1000, kReopenMaxMs = 30000 };
+
+    int epollFd;
+    int wakeFd;
+    std::atomic<bool> running;
+    std::thread loop;
+    std::vector<std::unique_ptr<Port>> ports;
+
+    std::mutex inboxMutex;
+    std::vector<std::pair<int, Transaction>> inbox;
+
+    static uint64_t tokenOf(int id, EventKind kind) {
+        return (static_cast<uint64_t>(id) << 2) | kind;
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t n = ::write(wakeFd, &one, sizeof(one));
+        (void)n;
+    }
+
+    void run() {
+        struct epoll_event events[64];
+        while (running.load()) {
+            int n = epoll_wait(epollFd, events, 64, -1);
+            if (n < 0 && errno != EINTR) {
+                std::cerr << "Serial reactor epoll_wait failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                uint64_t token = events[i].data.u64;
+                if (token == kWakeToken) {
+                    uint64_t value;
+                    ssize_t r = ::read(wakeFd, &value, sizeof(value));
+                    (void)r;
+                    drainInbox();
+                    continue;
+                }
+                Port& port = *ports[token >> 2];
+                switch (token & 3) {
+                    case TimerEvent: onTimer(port); break;
+                    case StreamTimerEvent: onStreamTimer(port); break;
+                    default: onPortEvent(port, events[i].events); break;
+                }
+            }
+        }
+
+        // 退出时让所有等待中的事务失败，避免调用者一直阻塞
+        drainInbox();
+        for (auto& port : ports) {
+            failAll(*port);
+        }
+    }
+
+    void drainInbox() {
+        std::vector<std::pair<int, Transaction>> items;
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            items.swap(inbox);
+        }
+        for (auto& item : items) {
+            Port& port = *ports[item.first];
+            if (port.failed || !running.load()) {
+                if (item.second.callback) {
+                    item.second.callback(false, nullptr, 0, Clock::now());
+                }
+                continue;
+            }
+            port.pending.push_back(std::move(item.second));
+            if (port.state == Idle) {
+                startNext(port);
+            }
+        }
+    }
+
+    void startNext(Port& port) {
+        if (port.pending.empty()) {
+            port.state = Idle;
+            return;
+        }
+        port.current = std::move(port.pending.front());
+        port.pending.pop_front();
+        if (!port.current.expectResponse) {
+            while (!port.pending.empty() && !port.pending.front().expectResponse) {
+                const std::vector<uint8_t>& next = port.pending.front().request;
+                port.current.request.insert(port.current.request.end(), next.begin(), next.end());
+                port.pending.pop_front();
+            }
+        }
+        port.rx.clear();
+        port.written = 0;
+        port.state = Writing;
+        if (port.current.expectResponse) {
+            port.stats.transactions.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // 发送前把缓冲区里残留的字节交给reader，没有reader则丢弃
+        if (port.streamReader) {
+            readStream(port);
+        } else {
+            uint8_t scratch[256];
+            while (::read(port.fd, scratch, sizeof(scratch)) > 0) {
+            }
+        }
+        writePending(port);
+    }
+
+    void writePending(Port& port) {
+        const std::vector<uint8_t>& request = port.current.request;
+        while (port.written < request.size()) {
+            ssize_t n = ::write(port.fd, request.data() + port.written, request.size() - port.written);
+            if (n > 0) {
+                port.written += static_cast<size_t>(n);
+                port.stats.bytesWritten.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                watchWritable(port, true);
+                return;
+            }
+            portFailed(port);
+            return;
+        }
+        watchWritable(port, false);
+
+        if (!port.current.expectResponse) {
+            port.current = Transaction();
+            startNext(port);
+            return;
+        }
+
+        // 请求写完后开始计应答超时，包含请求本身在线上的发送时间
+        port.state = AwaitingResponse;
+        int64_t nanos = static_cast<int64_t>(port.current.timeoutMs) * 1000000 +
+                        port.config.charsToMicros(static_cast<double>(request.size())) * 1000;
+        armTimer(port, nanos);
+    }
+
+    void onPortEvent(Port& port, uint32_t events) {
+        // 同一批事件中串口已经出错关闭
+        if (port.failed) {
+            return;
+        }
+        if (events & EPOLLIN) {
+            readAvailable(port);
+        }
+        if ((events & EPOLLOUT) && port.state == Writing) {
+            writePending(port);
+        }
+        if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+            portFailed(port);
+        }
+    }
+
+    void readAvailable(Port& port) {
+        if (port.streamReader && port.state != AwaitingResponse && port.state != Receiving) {
+            readStream(port);
+            return;
+        }
+
+        uint8_t buffer[512];
+        while (true) {
+            ssize_t n = ::read(port.fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN) {
+                portFailed(port);
+            }
+            if (n <= 0) {
+                return;
+            }
+            port.stats.bytesRead.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+            if (port.state != AwaitingResponse && port.state != Receiving) {
+                port.stats.unsolicitedBytes.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+                continue;
+            }
+            port.rx.insert(port.rx.end(), buffer, buffer + n);
+            port.state = Receiving;
+            if (port.current.expectedLength != 0 && port.rx.size() >= port.current.expectedLength) {
+                complete(port, true);
+                return;
+            }
+            // 每收到一批字节就重新计 t3.5，静默超过 t3.5 即认为一帧结束
+            armTimer(port, port.gapNanos);
+        }
+    }
+
+    void readStream(Port& port) {
+        bool received = false;
+        while (true) {
+            ssize_t n = port.streamReader->readFrom(port.fd);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN) {
+                portFailed(port);
+            }
+            if (n <= 0) {
+                break;
+            }
+            received = true;
+            port.stats.bytesRead.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        }
+        if (received) {
+            armTimer(port.streamTimerFd, port.gapNanos);
+        }
+    }
+
+    void onStreamTimer(Port& port) {
+        uint64_t expirations;
+        if (::read(port.streamTimerFd, &expirations, sizeof(expirations)) > 0 && port.streamReader) {
+            port.streamReader->onSilence();
+        }
+    }
+
+    void onTimer(Port& port) {
+        uint64_t expirations;
+        if (::read(port.timerFd, &expirations, sizeof(expirations)) <= 0) {
+            return;
+        }
+        if (port.failed) {
+            reopen(port);
+            return;
+        }
+        switch (port.state) {
+            case AwaitingResponse:
+                port.stats.timeouts.fetch_add(1, std::memory_order_relaxed);
+                complete(port, false);
+                break;
+            case Receiving:
+                complete(port, true);
+                break;
+            case Silence:
+                startNext(port);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void complete(Port& port, bool ok) {
+        Clock::time_point completedAt = Clock::now();
+        Transaction transaction = std::move(port.current);
+        port.current = Transaction();
+        transaction.callback(ok, port.rx.data(), port.rx.size(), completedAt);
+
+        // 下一帧发送前保持 t3.5 的总线静默
+        port.state = Silence;
+        armTimer(port, port.gapNanos);
+    }
+
+    void portFailed(Port& port) {
+        if (port.failed) {
+            return;
+        }
+        // 打开后不久又出错时退避加倍，正常用了一段时间才出错时从头开始
+        if (Clock::now() - port.openedAt >= std::chrono::milliseconds(kReopenMaxMs)) {
+            port.reopenBackoffMs = kReopenMinMs;
+        } else {
+            port.reopenBackoffMs = std::min(std::max(port.reopenBackoffMs * 2, static_cast<int>(kReopenMinMs)),
+                                            static_cast<int>(kReopenMaxMs));
+        }
+        std::cerr << "Serial port " << port.config.instance << " failed, reopening in " << port.reopenBackoffMs << " ms"
+                  << std::endl;
+        port.failed = true;
+        port.stats.failures.fetch_add(1, std::memory_order_relaxed);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, port.fd, nullptr);
+        ::close(port.fd);
+        port.fd = -1;
+        failAll(port);
+        if (port.streamReader) {
+            port.streamReader->onSilence();
+        }
+        armTimer(port, static_cast<int64_t>(port.reopenBackoffMs) * 1000000);
+    }
+
+    void reopen(Port& port) {
+        int fd = openSerialPort(port.config);
+        if (fd < 0) {
+            port.reopenBackoffMs = std::min(port.reopenBackoffMs * 2, static_cast<int>(kReopenMaxMs));
+            armTimer(port, static_cast<int64_t>(port.reopenBackoffMs) * 1000000);
+            return;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = tokenOf(port.id, PortEvent);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        port.fd = fd;
+        port.failed = false;
+        port.openedAt = Clock::now();
+        port.stats.reopens.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Serial port " << port.config.instance << " reopened" << std::endl;
+        startNext(port);
+    }
+
+    void failAll(Port& port) {
+        if (port.state == Writing || port.state == AwaitingResponse || port.state == Receiving) {
+            Transaction transaction = std::move(port.current);
+            port.current = Transaction();
+            if (transaction.callback) {
+                transaction.callback(false, nullptr, 0, Clock::now());
+            }
+        }
+        while (!port.pending.empty()) {
+            Transaction transaction = std::move(port.pending.front());
+            port.pending.pop_front();
+            if (transaction.callback) {
+                transaction.callback(false, nullptr, 0, Clock::now());
+            }
+        }
+        port.state = Idle;
+    }
+
+    void watchWritable(Port& port, bool writable) {
+        struct epoll_event event;
+        event.events = writable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.u64 = tokenOf(port.id, PortEvent);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, port.fd, &event);
+    }
+
+    void armTimer(Port& port, int64_t nanos) {
+        armTimer(port.timerFd, nanos);
+    }
+
+    // nanos 为0时关闭定时器
+    void armTimer(int timerFd, int64_t nanos) {
+        struct itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = nanos / 1000000000;
+        spec.it_value.tv_nsec = nanos % 1000000000;
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+    }
+
+    void closePort(Port& port) {
+        if (port.fd >= 0) {
+            ::close(port.fd);
+            port.fd = -1;
+        }
+        if (port.timerFd >= 0) {
+            ::close(port.timerFd);
+            port.timerFd = -1;
+        }
+        if (port.streamTimerFd >= 0) {
+            ::close(port.streamTimerFd);
+            port.streamTimerFd = -1;
+        }
+    }
+};
+
+// 把reactor上的一个串口包装成同步的请求/应答传输，供采集线程使用
+class ReactorTransport : public SerialTransport {
+public:
+    ReactorTransport(SerialReactor& reactor, int portId) : reactor(reactor), portId(portId) {}
+
+    bool transact(const std::vector<uint8_t>& request, size_t expectedLength,
+                  std::vector<uint8_t>& response, int timeoutMs,
+                  SerialReactor::Clock::time_point& completedAt) override {
+        std::shared_ptr<std::promise<bool>> done = std::make_shared<std::promise<bool>>();
+        std::shared_ptr<std::vector<uint8_t>> frame = std::make_shared<std::vector<uint8_t>>();
+        std::shared_ptr<SerialReactor::Clock::time_point> completed = std::make_shared<SerialReactor::Clock::time_point>();
+        std::future<bool> result = done->get_future();
+        reactor.submit(portId, request, expectedLength, timeoutMs,
+                       [done, frame, completed](bool ok, const uint8_t* data, size_t size, SerialReactor::Clock::time_point at) {
+                           if (data != nullptr) {
+                               frame->assign(data, data + size);
+                           }
+                           *completed = at;
+                           done->set_value(ok);
+                       });
+        bool ok = result.get();
+        response.swap(*frame);
+        completedAt = *completed;
+        return ok && !response.empty();
+    }
+
+private:
+    SerialReactor& reactor;
+    int portId;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cpp_redis/cpp_redis>
+#include <json/json.h>
+#include "redis_pool.h"
+
+// 按时间查询历史数据的redis有序集合索引
+// 每个设备一个 zset（indexPrefix + uuid），score 为采集时间(epoch ms)，成员为 "时间|值1|值2..."；
+// 字段名按同样的顺序保存在 indexPrefix + uuid + ":fields" 中。时间放在成员里保证相同的值在不同时刻也是不同的成员。
+
+// 值中的 '|' 和 '\' 用 '\' 转义
+inline void appendIndexValue(std::string& out, const std::string& value) {
+    for (char c : value) {
+        if (c == '|' || c == '\\') {
+            out.push_back('\\');
+        }
+        out.push_back(c);
+    }
+}
+
+// count 为只取前几项，默认全部
+inline std::string encodeIndexMember(int64_t ms, const std::vector<std::string>& values, size_t count = std::string::npos) {
+    std::string member = std::to_string(ms);
+    for (size_t i = 0; i < values.size() && i < count; ++i) {
+        member.push_back('|');
+        appendIndexValue(member, values[i]);
+    }
+    return member;
+}
+
+inline std::string encodeIndexFields(const std::vector<std::string>& fields, size_t count = std::string::npos) {
+    std::string encoded;
+    for (size_t i = 0; i < fields.size() && i < count; ++i) {
+        if (i > 0) {
+            encoded.push_back('|');
+        }
+        appendIndexValue(encoded, fields[i]);
+    }
+    return encoded;
+}
+
+inline std::vector<std::string> splitIndexValues(const std::string& member) {
+    std::vector<std::string> parts(1);
+    for (size_t i = 0; i < member.size(); ++i) {
+        char c = member[i];
+        if (c == '\\' && i + 1 < member.size()) {
+            parts.back().push_back(member[++i]);
+        } else if (c == '|') {
+            parts.push_back(std::string());
+        } else {
+            parts.back().push_back(c);
+        }
+    }
+    return parts;
+}
+
+// 支持毫秒时间戳，或本地时间 "YYYY-MM-DDTHH:MM:SS"（与数据中的 timestamp 相同）
+inline bool parseIndexTime(const Json::Value& value, int64_t& ms) {
+    if (value.isNumeric()) {
+        ms = value.asInt64();
+        return true;
+    }
+    if (!value.isString()) {
+        return false;
+    }
+    struct tm tm = {};
+    const std::string text = value.asString();
+    if (strptime(text.c_str(), "%Y-%m-%dT%H:%M:%S", &tm) == nullptr) {
+        return false;
+    }
+    tm.tm_isdst = -1;
+    ms = static_cast<int64_t>(mktime(&tm)) * 1000;
+    return true;
+}
+
+// 网关上的范围查询：ZRANGEBYSCORE 按score二分定位，只读取范围内的成员，不扫描整个历史
+// 每个redis实例保持一条同步查询连接，由命令处理线程调用
+class TimeIndexQuery {
+public:
+    using ptr = std::shared_ptr<TimeIndexQuery>;
+
+    explicit TimeIndexQuery(const RedisPool::ptr& redisPool)
+        : redisPool(redisPool), clients(redisPool->endpoints().size()) {}
+
+    // 返回 [{"captured-at":ms, 字段:值...}, ...]，按时间升序，最多 limit 条
+    Json::Value range(const std::string& uuid, int64_t fromMs, int64_t toMs, size_t limit, int timeoutMs = 3000) {
+        Json::Value samples(Json::arrayValue);
+        std::lock_guard<std::mutex> lock(mutex);
+        cpp_redis::client* client = clientFor(uuid);
+        if (client == nullptr) {
+            return samples;
+        }
+        const std::string key = redisPool->getConfig().indexPrefix + uuid;
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        client->send({"GET", key + ":fields"}, [result](cpp_redis::reply& reply) {
+            if (reply.is_string()) {
+                std::lock_guard<std::mutex> lock(result->mutex);
+                result->fields = splitIndexValues(reply.as_string());
+            }
+        });
+        client->send({"ZRANGEBYSCORE", key, std::to_string(fromMs), std::to_string(toMs), "LIMIT", "0", std::to_string(limit)},
+            [result](cpp_redis::reply& reply) {
+                if (!reply.is_array()) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(result->mutex);
+                for (const auto& item : reply.as_array()) {
+                    if (item.is_string()) {
+                        result->members.push_back(item.as_string());
+                    }
+                }
+            });
+        try {
+            client->sync_commit(std::chrono::milliseconds(timeoutMs));
+        } catch (const std::exception& e) {
+            std::cerr << "Time index query failed: " << e.what() << std::endl;
+        }
+
+        std::lock_guard<std::mutex> resultLock(result->mutex);
+        for (const auto& member : result->members) {
+            std::vector<std::string> parts = splitIndexValues(member);
+            Json::Value sample;
+            sample["captured-at"] = Json::Int64(std::strtoll(parts[0].c_str(), nullptr, 10));
+            for (size_t i = 1; i < parts.size(); ++i) {
+                const std::string field = i - 1 < result->fields.size() ? result->fields[i - 1] : "field" + std::to_string(i - 1);
+                sample[field] = parts[i];
+            }
+            samples.append(sample);
+        }
+        return samples;
+    }
+
+private:
+    struct Result {
+        std::mutex mutex;
+        std::vector<std::string> fields;
+        std::vector<std::string> members;
+    };
+
+    RedisPool::ptr redisPool;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<cpp_redis::client>> clients;
+
+    cpp_redis::client* clientFor(const std::string& uuid) {
+        size_t index = redisPool->endpointFor(uuid);
+        std::unique_ptr<cpp_redis::client>& client = clients[index];
+        if (client && client->is_connected()) {
+            return client.get();
+        }
+        const RedisEndpoint& endpoint = redisPool->endpoints()[index];
+        client.reset(new cpp_redis::client());
+        try {
+            client->connect(endpoint.host, static_cast<size_t>(endpoint.port));
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to connect to redis " << endpoint.host << ":" << endpoint.port << ": " << e.what() << std::endl;
+            client.reset();
+            return nullptr;
+        }
+        return client.get();
+    }
+};
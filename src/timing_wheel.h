@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 分层时间轮
+// 第0层256个槽，每槽1个tick；第1~3层各64个槽，每槽分别覆盖256、16384、1048576个tick。
+// 定时器按id索引，节点之间用下标组成双向链表，插入/删除/每tick推进都是O(1)，
+// 高层槽位在低层转满一圈时级联下放，每个定时器最多被级联3次。
+class TimingWheel {
+public:
+    enum : uint32_t { npos = 0xFFFFFFFFu };
+
+    explicit TimingWheel(size_t capacity = 0) : currentTick(0), activeCount(0) {
+        heads.assign(kTotalSlots, npos);
+        resize(capacity);
+    }
+
+    // 定时器id的取值范围为[0, capacity)
+    void resize(size_t capacity) {
+        nodes.resize(capacity);
+    }
+
+    size_t capacity() const { return nodes.size(); }
+    size_t size() const { return activeCount; }
+    uint64_t now() const { return currentTick; }
+
+    bool scheduled(uint32_t id) const {
+        return id < nodes.size() && nodes[id].slot != npos;
+    }
+
+    // 在expireTick到期；早于当前tick的会在下一次tick()时到期
+    void schedule(uint32_t id, uint64_t expireTick) {
+        if (id >= nodes.size()) {
+            return;
+        }
+        if (nodes[id].slot != npos) {
+            unlink(id);
+        }
+        nodes[id].expire = expireTick;
+        place(id);
+    }
+
+    void cancel(uint32_t id) {
+        if (scheduled(id)) {
+            unlink(id);
+        }
+    }
+
+    // 处理当前tick的槽位，把到期的id追加到expired，然后前进一格
+    void tick(std::vector<uint32_t>& expired) {
+        uint32_t index = static_cast<uint32_t>(currentTick & (kLevel0Slots - 1));
+        if (index == 0 && currentTick != 0) {
+            // 第0层转满一圈，依次从上层级联
+            for (uint32_t level = 1; level < kLevels; ++level) {
+                uint32_t upper = static_cast<uint32_t>((currentTick >> shiftOf(level)) & (kUpperSlots - 1));
+                cascade(slotOf(level, upper));
+                if (upper != 0) {
+                    break;
+                }
+            }
+        }
+
+        uint32_t slot = index;
+        uint32_t id = heads[slot];
+        while (id != npos) {
+            uint32_t next = nodes[id].next;
+            unlink(id);
+            expired.push_back(id);
+            id = next;
+        }
+        ++currentTick;
+    }
+
+    // 推进到targetTick（含），即处理所有expire <= targetTick的定时器
+    void advanceTo(uint64_t targetTick, std::vector<uint32_t>& expired) {
+        while (currentTick <= targetTick) {
+            tick(expired);
+        }
+    }
+
+private:
+    enum : uint32_t {
+        kLevels = 4,
+        kLevel0Bits = 8,
+        kUpperBits = 6,
+        kLevel0Slots = 1u << kLevel0Bits,
+        kUpperSlots = 1u << kUpperBits,
+        kTotalSlots = kLevel0Slots + kUpperSlots * (kLevels - 1)
+    };
+    static const uint64_t kMaxSpan = 1ull << (kLevel0Bits + kUpperBits * (kLevels - 1));
+
+    struct Node {
+        uint64_t expire = 0;
+        uint32_t prev = npos;
+        uint32_t next = npos;
+        uint32_t slot = npos;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> heads;
+    uint64_t currentTick;
+    size_t activeCount;
+
+    static uint32_t shiftOf(uint32_t level) {
+        return kLevel0Bits + kUpperBits * (level - 1);
+    }
+
+    static uint32_t slotOf(uint32_t level, uint32_t index) {
+        return kLevel0Slots + kUpperSlots * (level - 1) + index;
+    }
+
+    void place(uint32_t id) {
+        uint64_t expire = nodes[id].expire < currentTick ? currentTick : nodes[id].expire;
+        uint64_t delta = expire - currentTick;
+        uint32_t slot;
+        if (delta < kLevel0Slots) {
+            slot = static_cast<uint32_t>(expire & (kLevel0Slots - 1));
+        } else {
+            if (delta >= kMaxSpan) {
+                // 超出时间轮范围的先挂在最高层，级联时再重新计算
+                expire = currentTick + kMaxSpan - 1;
+                delta = kMaxSpan - 1;
+            }
+            uint32_t level = 1;
+            while (level < kLevels - 1 && delta >= (1ull << shiftOf(level + 1))) {
+                ++level;
+            }
+            slot = slotOf(level, static_cast<uint32_t>((expire >> shiftOf(level)) & (kUpperSlots - 1)));
+        }
+        link(id, slot);
+    }
+
+    void cascade(uint32_t slot) {
+        uint32_t id = heads[slot];
+        heads[slot] = npos;
+        while (id != npos) {
+            uint32_t next = nodes[id].next;
+            nodes[id].slot = npos;
+            --activeCount;
+            place(id);
+            id = next;
+        }
+    }
+
+    void link(uint32_t id, uint32_t slot) {
+        Node& node = nodes[id];
+        node.slot = slot;
+        node.prev = npos;
+        node.next = heads[slot];
+        if (node.next != npos) {
+            nodes[node.next].prev = id;
+        }
+        heads[slot] = id;
+        ++activeCount;
+    }
+
+    void unlink(uint32_t id) {
+        Node& node = nodes[id];
+        if (node.prev != npos) {
+            nodes[node.prev].next = node.next;
+        } else {
+            heads[node.slot] = node.next;
+        }
+        if (node.next != npos) {
+            nodes[node.next].prev = node.prev;
+        }
+        node.prev = node.next = node.slot = npos;
+        --activeCount;
+    }
+};